@@ -0,0 +1,122 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <esp_attr.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "evmux.h"
+
+esp_err_t
+evmux_init (evmux_t * p_mux, evmux_source_t * p_sources, uint16_t max_sources, UBaseType_t q_depth)
+{
+    p_mux->h_queue = xQueueCreate(q_depth, sizeof(evmux_event_t));
+
+    if (NULL == p_mux->h_queue)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    p_mux->p_sources = p_sources;
+    p_mux->n_sources = 0;
+    p_mux->max_sources = max_sources;
+    p_mux->n_drop = 0;
+    p_mux->n_dispatch = 0;
+    p_mux->lat_min_us = UINT32_MAX;
+    p_mux->lat_max_us = 0;
+    p_mux->lat_sum_us = 0;
+
+    return ESP_OK;
+}
+
+int32_t
+evmux_register (evmux_t * p_mux, evmux_handler_t p_handler, void * p_ctx)
+{
+    int32_t source = -1;
+
+    // Le sorgenti si registrano prima di generare eventi: la tabella non
+    // cambia piu' mentre il dispatcher e' attivo.
+    //
+    if ((p_handler != NULL) && (p_mux->n_sources < p_mux->max_sources))
+    {
+        source = p_mux->n_sources;
+        p_mux->p_sources[source].p_handler = p_handler;
+        p_mux->p_sources[source].p_ctx = p_ctx;
+        p_mux->n_sources++;
+    }
+
+    return source;
+}
+
+BaseType_t
+evmux_post (evmux_t * p_mux, uint16_t source, uint32_t value, TickType_t ticks)
+{
+    evmux_event_t evt = {source, value, 0};
+    BaseType_t ret = xQueueSendToBack(p_mux->h_queue, &evt, ticks);
+
+    if (ret != pdPASS)
+    {
+        p_mux->n_drop++;
+    }
+
+    return ret;
+}
+
+BaseType_t IRAM_ATTR
+evmux_post_from_isr (evmux_t * p_mux, uint16_t source, uint32_t value, int64_t usecs, BaseType_t * p_woken)
+{
+    evmux_event_t evt = {source, value, usecs};
+    BaseType_t ret = xQueueSendToBackFromISR(p_mux->h_queue, &evt, p_woken);
+
+    if (ret != pdPASS)
+    {
+        p_mux->n_drop++;
+    }
+
+    return ret;
+}
+
+BaseType_t
+evmux_dispatch (evmux_t * p_mux, TickType_t ticks)
+{
+    evmux_event_t evt = {0};
+    uint32_t lat = 0;
+    BaseType_t ret = 0;
+
+    ret = xQueueReceive(p_mux->h_queue, &evt, ticks);
+
+    if (pdPASS == ret)
+    {
+        assert(evt.source < p_mux->n_sources);
+
+        // Latenza dal timestamp preso all'ingresso dell'ISR fino all'handler:
+        // comprende coda, risveglio del task e gli eventi serviti prima.
+        //
+        if (evt.usecs != 0)
+        {
+            lat = (uint32_t) (esp_timer_get_time() - evt.usecs);
+            p_mux->n_dispatch++;
+            p_mux->lat_sum_us += lat;
+            p_mux->lat_min_us = (lat < p_mux->lat_min_us) ? lat : p_mux->lat_min_us;
+            p_mux->lat_max_us = (lat > p_mux->lat_max_us) ? lat : p_mux->lat_max_us;
+        }
+
+        p_mux->p_sources[evt.source].p_handler(p_mux->p_sources[evt.source].p_ctx, evt.value);
+    }
+
+    return ret;
+}
+
+// Da chiamare dal task del dispatcher: le statistiche non sono protette
+//
+void
+evmux_print_stats (const evmux_t * p_mux)
+{
+    printf("evmux: %u isr events, %u dropped\n", p_mux->n_dispatch, p_mux->n_drop);
+
+    if (p_mux->n_dispatch > 0)
+    {
+        printf("evmux: isr->dispatch us min %u avg %llu max %u\n",
+               p_mux->lat_min_us, p_mux->lat_sum_us / p_mux->n_dispatch, p_mux->lat_max_us);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef EVMUX_H
+#define EVMUX_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <esp_err.h>
+#include <stdint.h>
+
+typedef void (* evmux_handler_t)(void * p_ctx, uint32_t value);
+
+typedef struct
+{
+    uint16_t source;        // Indice della sorgente nella tabella
+    uint32_t value;
+    int64_t usecs;          // Ingresso dell'ISR, 0 = evento da task
+} evmux_event_t;
+
+typedef struct
+{
+    evmux_handler_t p_handler;
+    void * p_ctx;
+} evmux_source_t;
+
+// Una sola coda per tutte le sorgenti: l'evento porta l'indice della
+// sorgente e il dispatch e' un accesso diretto alla tabella.
+//
+typedef struct
+{
+    QueueHandle_t h_queue;
+    evmux_source_t * p_sources;
+    uint16_t n_sources;
+    uint16_t max_sources;
+    uint32_t n_drop;
+    uint32_t n_dispatch;    // Eventi da ISR consegnati, scritti dal dispatcher
+    uint32_t lat_min_us;    // Ingresso ISR -> chiamata dell'handler
+    uint32_t lat_max_us;
+    uint64_t lat_sum_us;
+} evmux_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+esp_err_t evmux_init(evmux_t * p_mux, evmux_source_t * p_sources, uint16_t max_sources, UBaseType_t q_depth);
+int32_t evmux_register(evmux_t * p_mux, evmux_handler_t p_handler, void * p_ctx);
+BaseType_t evmux_post(evmux_t * p_mux, uint16_t source, uint32_t value, TickType_t ticks);
+BaseType_t evmux_post_from_isr(evmux_t * p_mux, uint16_t source, uint32_t value, int64_t usecs, BaseType_t * p_woken);
+BaseType_t evmux_dispatch(evmux_t * p_mux, TickType_t ticks);
+void evmux_print_stats(const evmux_t * p_mux);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVMUX_H */
@@ -2,8 +2,10 @@
 #include <freertos/task.h>
 #include <freertos/queue.h>
 #include <driver/gpio.h>
+#include <esp_timer.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "../components/evmux/evmux.h"
 
 #define GPIO_LED1   GPIO_NUM_18
 #define GPIO_LED2   GPIO_NUM_19
@@ -15,80 +17,171 @@
 
 #define N_BUTTONS   3
 #define Q_DEPTH     8
+#define STATS_MS    10000
 
-static void IRAM_ATTR isr_gpio1();
-static void IRAM_ATTR isr_gpio2();
-static void IRAM_ATTR isr_gpio3();
+// 1: confronto eventi/s fra evmux e QueueSet all'avvio
+#define BENCH_EVMUX 0
+#define BENCH_LOOPS 10000
+#define BENCH_MAX   256
 
 typedef struct 
 {
     int32_t         butn_gpio;
     int32_t         led_gpio;
-    QueueHandle_t   h_queue;
-    gpio_isr_t      p_isr;
+    int32_t         source;
 } button_t;
 
 button_t g_buttons[N_BUTTONS] = {
-    {GPIO_BUT1, GPIO_LED1, NULL, isr_gpio1},
-    {GPIO_BUT2, GPIO_LED2, NULL, isr_gpio2},
-    {GPIO_BUT3, GPIO_LED3, NULL, isr_gpio3}
+    {GPIO_BUT1, GPIO_LED1, -1},
+    {GPIO_BUT2, GPIO_LED2, -1},
+    {GPIO_BUT3, GPIO_LED3, -1}
 };
 
-inline static BaseType_t IRAM_ATTR
-isr_gpiox (uint8_t gpiox)
+static evmux_t g_evmux = {0};
+static evmux_source_t g_sources[N_BUTTONS] = {0};
+
+// Un'unica ISR per tutti i pulsanti: il pulsante arriva come argomento.
+// Livello e timestamp sono presi all'ingresso, non piu' tardi nel task.
+//
+static void IRAM_ATTR
+isr_button (void * p_arg)
 {
-    bool state = gpio_get_level(g_buttons[gpiox].butn_gpio);
+    int64_t usecs = esp_timer_get_time();
+    button_t * p_button = (button_t *) p_arg;
+    bool state = gpio_get_level(p_button->butn_gpio);
     BaseType_t woken = pdFALSE;
 
-    xQueueSendToBackFromISR(g_buttons[gpiox].h_queue, &state, &woken);
-    return woken;
+    evmux_post_from_isr(&g_evmux, p_button->source, state, usecs, &woken);
+
+    if (woken != 0)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+static void
+button_handler (void * p_ctx, uint32_t value)
+{
+    button_t * p_button = (button_t *) p_ctx;
+
+    ESP_ERROR_CHECK(gpio_set_level(p_button->led_gpio, value));
 }
 
 static void
 task_ev (void * p_param)
 {
+    evmux_t * p_mux = (evmux_t *) p_param;
+    TickType_t last = xTaskGetTickCount();
+
     for (;;)
     {
-        QueueSetHandle_t h_qset = (QueueSetHandle_t) p_param;
-        QueueSetMemberHandle_t h_memberset = NULL;
-        bool b_state = false;
-        BaseType_t ret = 0;
+        evmux_dispatch(p_mux, pdMS_TO_TICKS(STATS_MS));
 
-        for (;;)
+        if ((xTaskGetTickCount() - last) >= pdMS_TO_TICKS(STATS_MS))
         {
-            h_memberset = xQueueSelectFromSet(h_qset, portMAX_DELAY);
+            last = xTaskGetTickCount();
+            evmux_print_stats(p_mux);
+        }
+    }
+}
+
+#if BENCH_EVMUX
+static void
+bench_nop (void * p_ctx, uint32_t value)
+{
+    (void) p_ctx;
+    (void) value;
+}
+
+static void
+bench_sources (uint32_t n_sources)
+{
+    static QueueHandle_t h_queues[BENCH_MAX] = {NULL};
+    static evmux_source_t sources[BENCH_MAX] = {0};
+    evmux_t mux = {0};
+    QueueSetHandle_t h_qset = NULL;
+    QueueSetMemberHandle_t h_member = NULL;
+    uint32_t value = 0;
+    int64_t usecs = 0;
+
+    assert(n_sources <= BENCH_MAX);
+
+    ESP_ERROR_CHECK(evmux_init(&mux, sources, n_sources, 1));
+
+    for (uint32_t idx = 0; idx < n_sources; ++idx)
+    {
+        evmux_register(&mux, bench_nop, NULL);
+    }
+
+    usecs = esp_timer_get_time();
+
+    for (uint32_t idx = 0; idx < BENCH_LOOPS; ++idx)
+    {
+        evmux_post(&mux, idx % n_sources, idx, 0);
+        evmux_dispatch(&mux, 0);
+    }
+
+    usecs = esp_timer_get_time() - usecs;
+    printf("evmux    %3u sources: %lld ev/s\n", n_sources, (int64_t) BENCH_LOOPS * 1000000 / usecs);
+    vQueueDelete(mux.h_queue);
+
+    h_qset = xQueueCreateSet(n_sources);
+    assert(h_qset != NULL);
 
-            for (uint32_t idx = 0; idx < N_BUTTONS; ++idx)
+    for (uint32_t idx = 0; idx < n_sources; ++idx)
+    {
+        h_queues[idx] = xQueueCreate(1, sizeof(uint32_t));
+        assert(h_queues[idx] != NULL);
+        xQueueAddToSet(h_queues[idx], h_qset);
+    }
+
+    usecs = esp_timer_get_time();
+
+    // Stesso schema di task_ev() originale: select, scansione lineare dei
+    // membri, receive dalla coda trovata.
+    //
+    for (uint32_t idx = 0; idx < BENCH_LOOPS; ++idx)
+    {
+        xQueueSendToBack(h_queues[idx % n_sources], &idx, 0);
+        h_member = xQueueSelectFromSet(h_qset, 0);
+
+        for (uint32_t src = 0; src < n_sources; ++src)
+        {
+            if (h_member == h_queues[src])
             {
-                if (h_memberset == g_buttons[idx].h_queue)
-                {
-                    ret = xQueueReceive(h_memberset, &b_state, 0);
-                    assert(pdPASS == ret);
-                    ESP_ERROR_CHECK(gpio_set_level(g_buttons[idx].led_gpio, b_state));
-                    break;
-                }
+                xQueueReceive(h_member, &value, 0);
+                bench_nop(NULL, value);
+                break;
             }
         }
     }
+
+    usecs = esp_timer_get_time() - usecs;
+    printf("queueset %3u sources: %lld ev/s\n", n_sources, (int64_t) BENCH_LOOPS * 1000000 / usecs);
+
+    // Le code appartenenti a un set non si possono cancellare: la memoria
+    // del benchmark resta allocata.
 }
+#endif /* BENCH_EVMUX */
 
 void
 app_main (void)
 {
     int32_t app_cpu = xPortGetCoreID();
-    QueueSetHandle_t h_qset = NULL;
     BaseType_t ret = 0;
 
-    h_qset = xQueueCreateSet(Q_DEPTH * N_BUTTONS);
-    assert(h_qset != NULL);
+#if BENCH_EVMUX
+    bench_sources(3);
+    bench_sources(32);
+    bench_sources(BENCH_MAX);
+#endif /* BENCH_EVMUX */
+
+    ESP_ERROR_CHECK(evmux_init(&g_evmux, g_sources, N_BUTTONS, Q_DEPTH * N_BUTTONS));
 
     for (uint32_t idx = 0; idx < N_BUTTONS; ++idx)
     {
-        g_buttons[idx].h_queue = xQueueCreate(Q_DEPTH, sizeof(bool));
-        assert(g_buttons[idx].h_queue != NULL);
-
-        ret = xQueueAddToSet(g_buttons[idx].h_queue, h_qset);
-        assert(pdPASS == ret);
+        g_buttons[idx].source = evmux_register(&g_evmux, button_handler, &g_buttons[idx]);
+        assert(g_buttons[idx].source >= 0);
 
         gpio_pad_select_gpio(g_buttons[idx].led_gpio);
         ESP_ERROR_CHECK(gpio_set_direction(g_buttons[idx].led_gpio, GPIO_MODE_OUTPUT));
@@ -101,41 +194,13 @@ app_main (void)
         ESP_ERROR_CHECK(gpio_set_intr_type(g_buttons[idx].butn_gpio, GPIO_INTR_ANYEDGE));
     }
 
-    ret = xTaskCreatePinnedToCore(task_ev, "evtask", 4096, (void *) h_qset, 1, NULL, app_cpu);
+    ret = xTaskCreatePinnedToCore(task_ev, "evtask", 4096, (void *) &g_evmux, 1, NULL, app_cpu);
     assert(pdPASS == ret);
 
     gpio_install_isr_service(0);
 
     for (uint32_t idx = 0; idx < N_BUTTONS; ++idx)
     {
-        ESP_ERROR_CHECK(gpio_isr_handler_add(g_buttons[idx].butn_gpio, g_buttons[idx].p_isr, NULL));
-    }
-}
-
-
-static void IRAM_ATTR
-isr_gpio1 ()
-{
-    if (isr_gpiox(0))
-    {
-        portYIELD_FROM_ISR();
+        ESP_ERROR_CHECK(gpio_isr_handler_add(g_buttons[idx].butn_gpio, isr_button, &g_buttons[idx]));
     }
 }
-
-static void IRAM_ATTR
-isr_gpio2 ()
-{
-    if (isr_gpiox(1))
-    {
-        portYIELD_FROM_ISR();
-    }
-}
-
-static void IRAM_ATTR
-isr_gpio3 ()
-{
-    if (isr_gpiox(2))
-    {
-        portYIELD_FROM_ISR();
-    }
-}
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_attr.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "evring.h"
+
+void
+evring_init (evring_t * p_ring, evring_event_t * p_buf, uint32_t size, TaskHandle_t h_consumer)
+{
+    assert(size > 0 && 0 == (size & (size - 1)));
+
+    p_ring->p_buf = p_buf;
+    p_ring->mask = size - 1;
+    p_ring->head = 0;
+    p_ring->tail = 0;
+    p_ring->n_drop = 0;
+    p_ring->high_water = 0;
+    p_ring->h_consumer = h_consumer;
+}
+
+static inline bool IRAM_ATTR
+push (evring_t * p_ring, const evring_event_t * p_evt, bool * p_was_empty)
+{
+    uint32_t head = p_ring->head;
+    uint32_t tail = __atomic_load_n(&p_ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t used = head - tail;
+
+    if (used > p_ring->mask)
+    {
+        p_ring->n_drop++;
+        *p_was_empty = false;
+        return false;
+    }
+
+    p_ring->p_buf[head & p_ring->mask] = *p_evt;
+    __atomic_store_n(&p_ring->head, head + 1, __ATOMIC_RELEASE);
+
+    if (used + 1 > p_ring->high_water)
+    {
+        p_ring->high_water = used + 1;
+    }
+
+    // Si notifica solo la transizione vuoto -> non vuoto: il consumatore
+    // svuota il ring prima di tornare in attesa.
+    //
+    *p_was_empty = (0 == used);
+
+    return true;
+}
+
+bool IRAM_ATTR
+evring_push_from_isr (evring_t * p_ring, const evring_event_t * p_evt, BaseType_t * p_woken)
+{
+    bool b_was_empty = false;
+    bool b_ret = push(p_ring, p_evt, &b_was_empty);
+
+    if (b_was_empty && (p_ring->h_consumer != NULL))
+    {
+        vTaskNotifyGiveFromISR(p_ring->h_consumer, p_woken);
+    }
+
+    return b_ret;
+}
+
+bool
+evring_push (evring_t * p_ring, const evring_event_t * p_evt)
+{
+    bool b_was_empty = false;
+    bool b_ret = push(p_ring, p_evt, &b_was_empty);
+
+    if (b_was_empty && (p_ring->h_consumer != NULL))
+    {
+        xTaskNotifyGive(p_ring->h_consumer);
+    }
+
+    return b_ret;
+}
+
+uint32_t
+evring_pop_batch (evring_t * p_ring, evring_event_t * p_evt, uint32_t max)
+{
+    uint32_t tail = p_ring->tail;
+    uint32_t head = __atomic_load_n(&p_ring->head, __ATOMIC_ACQUIRE);
+    uint32_t count = head - tail;
+
+    if (count > max)
+    {
+        count = max;
+    }
+
+    for (uint32_t idx = 0; idx < count; ++idx)
+    {
+        p_evt[idx] = p_ring->p_buf[(tail + idx) & p_ring->mask];
+    }
+
+    __atomic_store_n(&p_ring->tail, tail + count, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+uint32_t
+evring_wait (evring_t * p_ring, TickType_t ticks)
+{
+    if (evring_count(p_ring) != 0)
+    {
+        return 1;
+    }
+
+    return ulTaskNotifyTake(pdTRUE, ticks);
+}
+
+uint32_t
+evring_count (const evring_t * p_ring)
+{
+    return __atomic_load_n(&p_ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&p_ring->tail, __ATOMIC_ACQUIRE);
+}
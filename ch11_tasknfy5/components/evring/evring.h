@@ -0,0 +1,47 @@
+#ifndef EVRING_H
+#define EVRING_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_attr.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+    int64_t usecs;          // Timestamp esp_timer al momento dell'evento
+    uint16_t source;
+    uint16_t value;
+} evring_event_t;
+
+// Ring single-producer/single-consumer senza lock: il produttore scrive solo
+// head, il consumatore solo tail.
+//
+typedef struct
+{
+    evring_event_t * p_buf;
+    uint32_t mask;          // Capacita' - 1, capacita' potenza di 2
+    uint32_t head;
+    uint32_t tail;
+    uint32_t n_drop;        // Eventi persi per ring pieno
+    uint32_t high_water;    // Massima occupazione osservata
+    TaskHandle_t h_consumer;
+} evring_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+void evring_init(evring_t * p_ring, evring_event_t * p_buf, uint32_t size, TaskHandle_t h_consumer);
+bool evring_push_from_isr(evring_t * p_ring, const evring_event_t * p_evt, BaseType_t * p_woken);
+bool evring_push(evring_t * p_ring, const evring_event_t * p_evt);
+uint32_t evring_pop_batch(evring_t * p_ring, evring_event_t * p_evt, uint32_t max);
+uint32_t evring_wait(evring_t * p_ring, TickType_t ticks);
+uint32_t evring_count(const evring_t * p_ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVRING_H */
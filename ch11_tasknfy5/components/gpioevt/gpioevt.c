@@ -0,0 +1,188 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <driver/gpio.h>
+#include <soc/gpio_struct.h>
+#include <esp_intr_alloc.h>
+#include <esp_timer.h>
+#include <esp_attr.h>
+#include <esp_err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "evring.h"
+#include "gpioevt.h"
+
+static evring_t g_ring = {0};
+static gpio_isr_handle_t gh_isr = NULL;
+static uint64_t g_pins = 0;         // Pin abilitati, letti dall'ISR
+static gpioevt_stats_t g_stats = {0};
+
+// Una sola ISR per tutti i pin: livello e istante sono presi all'ingresso,
+// prima che il task possa leggere un valore gia' cambiato.
+//
+static void IRAM_ATTR
+isr_gpio (void * p_arg)
+{
+    int64_t usecs = esp_timer_get_time();
+    uint32_t status = GPIO.status;
+    uint32_t status1 = GPIO.status1.intr_st;
+    uint64_t pending = 0;
+    uint64_t level = 0;
+    evring_event_t evt = {0};
+    BaseType_t woken = pdFALSE;
+
+    GPIO.status_w1tc = status;
+    GPIO.status1_w1tc.intr_st = status1;
+
+    pending = (((uint64_t) status1 << 32) | status) & g_pins;
+    level = ((uint64_t) GPIO.in1.data << 32) | GPIO.in;
+    evt.usecs = usecs;
+    g_stats.n_isr++;
+
+    while (pending != 0)
+    {
+        uint32_t gpio = __builtin_ctzll(pending);
+
+        pending &= pending - 1;
+        evt.source = gpio;
+        evt.value = (level >> gpio) & 1;
+        evring_push_from_isr(&g_ring, &evt, &woken);
+    }
+
+    if (woken != 0)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+esp_err_t
+gpioevt_init (evring_event_t * p_buf, uint32_t size, TaskHandle_t h_consumer)
+{
+    if (gh_isr != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    evring_init(&g_ring, p_buf, size, h_consumer);
+    memset(&g_stats, 0, sizeof(g_stats));
+    g_stats.lat_min_us = UINT32_MAX;
+
+    // Non compatibile con gpio_install_isr_service(): l'ISR e' unica
+    return gpio_isr_register(isr_gpio, NULL, ESP_INTR_FLAG_IRAM, &gh_isr);
+}
+
+esp_err_t
+gpioevt_add (gpio_num_t gpio, gpio_int_type_t intr_type, bool b_pullup)
+{
+    esp_err_t ret = ESP_OK;
+    gpio_config_t io_cfg = {0};
+
+    if (!GPIO_IS_VALID_GPIO(gpio))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    io_cfg.pin_bit_mask = BIT64(gpio);
+    io_cfg.mode = GPIO_MODE_INPUT;
+    io_cfg.pull_up_en = b_pullup ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE;
+    io_cfg.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    io_cfg.intr_type = intr_type;
+
+    __atomic_fetch_or(&g_pins, BIT64(gpio), __ATOMIC_RELAXED);
+    ret = gpio_config(&io_cfg);
+
+    if (ret != ESP_OK)
+    {
+        __atomic_fetch_and(&g_pins, ~BIT64(gpio), __ATOMIC_RELAXED);
+    }
+
+    return ret;
+}
+
+static void
+account_wake (const evring_event_t * p_evt, uint32_t count)
+{
+    uint32_t lat = (uint32_t) (esp_timer_get_time() - p_evt[0].usecs);
+    uint32_t bucket = 0;
+
+    // La latenza si misura sul primo evento del lotto: e' quello che ha
+    // svegliato il task.
+    //
+    g_stats.n_wakes++;
+    g_stats.n_events += count;
+    g_stats.lat_sum_us += lat;
+
+    if (lat < g_stats.lat_min_us)
+    {
+        g_stats.lat_min_us = lat;
+    }
+
+    if (lat > g_stats.lat_max_us)
+    {
+        g_stats.lat_max_us = lat;
+    }
+
+    while ((lat > 1) && (bucket < GPIOEVT_HIST_BUCKETS - 1))
+    {
+        lat >>= 1;
+        ++bucket;
+    }
+
+    g_stats.hist[bucket]++;
+}
+
+uint32_t
+gpioevt_read (evring_event_t * p_evt, uint32_t max, TickType_t ticks)
+{
+    uint32_t count = evring_pop_batch(&g_ring, p_evt, max);
+
+    if (0 == count)
+    {
+        evring_wait(&g_ring, ticks);
+        count = evring_pop_batch(&g_ring, p_evt, max);
+
+        if (count > 0)
+        {
+            account_wake(p_evt, count);
+        }
+    }
+    else
+    {
+        g_stats.n_events += count;
+    }
+
+    return count;
+}
+
+void
+gpioevt_get_stats (gpioevt_stats_t * p_stats)
+{
+    *p_stats = g_stats;
+    p_stats->n_drop = g_ring.n_drop;
+    p_stats->high_water = g_ring.high_water;
+}
+
+void
+gpioevt_print_stats (void)
+{
+    gpioevt_stats_t stats = {0};
+
+    gpioevt_get_stats(&stats);
+
+    printf("gpioevt: %u isr, %u events, %u wakes, %u dropped, high water %u\n",
+           stats.n_isr, stats.n_events, stats.n_wakes, stats.n_drop, stats.high_water);
+
+    if (stats.n_wakes > 0)
+    {
+        printf("gpioevt: isr->task us min %u avg %llu max %u\n",
+               stats.lat_min_us, stats.lat_sum_us / stats.n_wakes, stats.lat_max_us);
+
+        for (uint32_t idx = 0; idx < GPIOEVT_HIST_BUCKETS; ++idx)
+        {
+            if (stats.hist[idx] != 0)
+            {
+                printf("gpioevt:   <%5u us %u\n", 2u << idx, stats.hist[idx]);
+            }
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef GPIOEVT_H
+#define GPIOEVT_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <driver/gpio.h>
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "evring.h"
+
+#define GPIOEVT_HIST_BUCKETS    12      // Istogramma in potenze di 2 di us
+
+typedef struct
+{
+    uint32_t n_isr;
+    uint32_t n_events;
+    uint32_t n_wakes;
+    uint32_t lat_min_us;    // Ingresso ISR -> risveglio del task
+    uint32_t lat_max_us;
+    uint64_t lat_sum_us;
+    uint32_t hist[GPIOEVT_HIST_BUCKETS];
+    uint32_t n_drop;
+    uint32_t high_water;
+} gpioevt_stats_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+esp_err_t gpioevt_init(evring_event_t * p_buf, uint32_t size, TaskHandle_t h_consumer);
+esp_err_t gpioevt_add(gpio_num_t gpio, gpio_int_type_t intr_type, bool b_pullup);
+uint32_t gpioevt_read(evring_event_t * p_evt, uint32_t max, TickType_t ticks);
+void gpioevt_get_stats(gpioevt_stats_t * p_stats);
+void gpioevt_print_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GPIOEVT_H */
@@ -1,7 +1,11 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
 #include <driver/gpio.h>
+#include <esp_timer.h>
 #include <stdio.h>
+#include "../components/evring/evring.h"
+#include "../components/gpioevt/gpioevt.h"
 
 #define GPIO_LED1   GPIO_NUM_18
 #define GPIO_LED2   GPIO_NUM_19
@@ -12,59 +16,96 @@
 #define GPIO_BUT3   GPIO_NUM_25
 
 #define N_BUTTONS   3
+#define RING_SIZE   32
+#define BATCH_SIZE  8
 
-static void IRAM_ATTR isr_gpio1();
-static void IRAM_ATTR isr_gpio2();
-static void IRAM_ATTR isr_gpio3();
+// 1: confronto di costo fra ring SPSC e coda FreeRTOS all'avvio
+#define BENCH_RING  0
+#define BENCH_LOOPS 10000
+
+#define STATS_MS    10000
 
 typedef struct
 {
     int32_t     butn_gpio;
     int32_t     led_gpio;
-    uint32_t    buttonx;
-    gpio_isr_t  p_isr;
 } button_t;
 
 static button_t g_buttons[N_BUTTONS] = {
-    {GPIO_BUT1, GPIO_LED1, 0u, isr_gpio1},
-    {GPIO_BUT2, GPIO_LED2, 1u, isr_gpio2},
-    {GPIO_BUT3, GPIO_LED3, 2u, isr_gpio3}
+    {GPIO_BUT1, GPIO_LED1},
+    {GPIO_BUT2, GPIO_LED2},
+    {GPIO_BUT3, GPIO_LED3}
 };
 
-static TaskHandle_t gh_task1 = NULL;
-
-inline static BaseType_t IRAM_ATTR
-isr_gpiox (uint8_t gpiox)
-{
-    BaseType_t woken = pdFALSE;
+// Il GPIO dell'evento indica direttamente il LED da pilotare
+static int32_t g_led_of_gpio[GPIO_NUM_MAX] = {0};
 
-    xTaskNotifyFromISR(gh_task1, 1 << g_buttons[gpiox].buttonx, eSetBits, &woken);
-    return woken;
-}
+static TaskHandle_t gh_task1 = NULL;
+static evring_event_t g_ring_buf[RING_SIZE] = {0};
 
 static void
 task1 (void * p_param)
 {
-    uint32_t evt = 0;
-    BaseType_t ret = 0;
-    uint32_t level = 0;
+    evring_event_t evt[BATCH_SIZE] = {0};
+    uint32_t count = 0;
+    TickType_t last = xTaskGetTickCount();
 
     for (;;)
     {
-        ret = xTaskNotifyWait(0, 0x7, &evt, portMAX_DELAY);
-        fprintf(stderr, "Task notified: rv = %u\n", evt);
+        count = gpioevt_read(evt, BATCH_SIZE, pdMS_TO_TICKS(STATS_MS));
 
-        for (int32_t idx = 0; idx < N_BUTTONS; ++idx)
+        for (uint32_t idx = 0; idx < count; ++idx)
         {
-            if (evt & (1 << idx))
-            {
-                level = gpio_get_level(g_buttons[idx].butn_gpio);
-                fprintf(stderr, "Button %u notified, reads %d\n", idx, level);
-                gpio_set_level(g_buttons[idx].led_gpio, level);
-            }
+            fprintf(stderr, "GPIO %u at %lld us reads %u\n", evt[idx].source, evt[idx].usecs, evt[idx].value);
+            gpio_set_level(g_led_of_gpio[evt[idx].source], evt[idx].value);
         }
+
+        if ((xTaskGetTickCount() - last) >= pdMS_TO_TICKS(STATS_MS))
+        {
+            last = xTaskGetTickCount();
+            gpioevt_print_stats();
+        }
+    }
+}
+
+#if BENCH_RING
+static void
+bench_ring (void)
+{
+    static evring_t ring = {0};
+    static evring_event_t buf[RING_SIZE] = {0};
+    QueueHandle_t h_queue = xQueueCreate(RING_SIZE, sizeof(evring_event_t));
+    evring_event_t evt = {0};
+    int64_t usecs = 0;
+
+    assert(h_queue != NULL);
+    evring_init(&ring, buf, RING_SIZE, NULL);
+
+    usecs = esp_timer_get_time();
+
+    for (uint32_t idx = 0; idx < BENCH_LOOPS; ++idx)
+    {
+        evring_push(&ring, &evt);
+        evring_pop_batch(&ring, &evt, 1);
+    }
+
+    usecs = esp_timer_get_time() - usecs;
+    printf("evring: %lld ns per push+pop\n", usecs * 1000 / BENCH_LOOPS);
+
+    usecs = esp_timer_get_time();
+
+    for (uint32_t idx = 0; idx < BENCH_LOOPS; ++idx)
+    {
+        xQueueSendToBack(h_queue, &evt, 0);
+        xQueueReceive(h_queue, &evt, 0);
     }
+
+    usecs = esp_timer_get_time() - usecs;
+    printf("queue:  %lld ns per send+receive\n", usecs * 1000 / BENCH_LOOPS);
+
+    vQueueDelete(h_queue);
 }
+#endif /* BENCH_RING */
 
 void
 app_main (void)
@@ -73,54 +114,31 @@ app_main (void)
     BaseType_t ret = 0;
 
     app_cpu = xPortGetCoreID();
-    
+
+#if BENCH_RING
+    bench_ring();
+#endif /* BENCH_RING */
+
     for (uint32_t idx = 0; idx < N_BUTTONS; ++idx)
     {
         gpio_pad_select_gpio(g_buttons[idx].led_gpio);
         ESP_ERROR_CHECK(gpio_set_direction(g_buttons[idx].led_gpio, GPIO_MODE_OUTPUT));
         ESP_ERROR_CHECK(gpio_set_level(g_buttons[idx].led_gpio, 1));
 
-        gpio_pad_select_gpio(g_buttons[idx].butn_gpio);
-        ESP_ERROR_CHECK(gpio_set_direction(g_buttons[idx].butn_gpio, GPIO_MODE_INPUT));
-        ESP_ERROR_CHECK(gpio_pullup_en(g_buttons[idx].butn_gpio));
-        ESP_ERROR_CHECK(gpio_pulldown_dis(g_buttons[idx].butn_gpio));
-        ESP_ERROR_CHECK(gpio_set_intr_type(g_buttons[idx].butn_gpio, GPIO_INTR_ANYEDGE));
+        g_led_of_gpio[g_buttons[idx].butn_gpio] = g_buttons[idx].led_gpio;
     }
 
     ret = xTaskCreatePinnedToCore(task1, "task1", 3000, NULL, 1, &gh_task1, app_cpu);
     assert(pdPASS == ret);
 
-    gpio_install_isr_service(0);
+    // Una sola ISR per tutti i pulsanti: aggiungere un ingresso non richiede
+    // un'altra funzione ISR.
+    //
+    ESP_ERROR_CHECK(gpioevt_init(g_ring_buf, RING_SIZE, gh_task1));
 
     for (uint32_t idx = 0; idx < N_BUTTONS; ++idx)
     {
-        ESP_ERROR_CHECK(gpio_isr_handler_add(g_buttons[idx].butn_gpio, g_buttons[idx].p_isr, NULL));
-    }
-}
-
-static void IRAM_ATTR
-isr_gpio1 ()
-{
-    if (isr_gpiox(0))
-    {
-        portYIELD_FROM_ISR();
-    }
-}
-
-static void IRAM_ATTR
-isr_gpio2 ()
-{
-    if (isr_gpiox(1))
-    {
-        portYIELD_FROM_ISR();
+        gpio_pad_select_gpio(g_buttons[idx].butn_gpio);
+        ESP_ERROR_CHECK(gpioevt_add(g_buttons[idx].butn_gpio, GPIO_INTR_ANYEDGE, true));
     }
 }
-
-static void IRAM_ATTR
-isr_gpio3 ()
-{
-    if (isr_gpiox(2))
-    {
-        portYIELD_FROM_ISR();
-    }
-}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "actroute.h"
+
+#define MAX_DIGITS  9       // Nessun overflow in uint32_t
+
+static const char *
+parse_uint (const char * p_in, uint32_t * p_value)
+{
+    const char * p_start = p_in;
+    uint32_t value = 0;
+
+    while ((*p_in >= '0') && (*p_in <= '9') && ((p_in - p_start) < MAX_DIGITS))
+    {
+        value = (value * 10) + (*p_in - '0');
+        ++p_in;
+    }
+
+    *p_value = value;
+
+    return (p_in != p_start) ? p_in : NULL;
+}
+
+// Una sola scansione dell'URI, senza sscanf: nome, indice e stato devono
+// essere completi, altrimenti la richiesta non corrisponde a nessun attuatore
+//
+bool
+actroute_parse (const actroute_t * p_table, uint32_t n_routes, const char * p_uri, actroute_match_t * p_match)
+{
+    const actroute_t * p_route = NULL;
+    const char * p_in = p_uri;
+    size_t len = 0;
+    uint32_t slot = 0;
+    uint32_t state = 0;
+
+    if (*p_in++ != '/')
+    {
+        return false;
+    }
+
+    while ((p_in[len] != '/') && (p_in[len] != '\0'))
+    {
+        ++len;
+    }
+
+    if ((0 == len) || (p_in[len] != '/'))
+    {
+        return false;
+    }
+
+    for (uint32_t idx = 0; idx < n_routes; ++idx)
+    {
+        if ((0 == strncmp(p_table[idx].p_name, p_in, len)) && ('\0' == p_table[idx].p_name[len]))
+        {
+            p_route = &p_table[idx];
+            break;
+        }
+    }
+
+    if (NULL == p_route)
+    {
+        return false;
+    }
+
+    p_in = parse_uint(p_in + len + 1, &slot);
+
+    if ((NULL == p_in) || (*p_in++ != '/'))
+    {
+        return false;
+    }
+
+    p_in = parse_uint(p_in, &state);
+
+    // Una query string eventuale viene ignorata
+    //
+    if ((NULL == p_in) || ((*p_in != '\0') && (*p_in != '?')))
+    {
+        return false;
+    }
+
+    if ((slot >= p_route->n_slots) || (state > p_route->max_state))
+    {
+        return false;
+    }
+
+    p_match->p_route = p_route;
+    p_match->slot = slot;
+    p_match->state = state;
+
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef ACTROUTE_H
+#define ACTROUTE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Un descrittore per tipo di attuatore: l'URI /<name>/{n}/{state} seleziona
+// lo slot first_slot + n dello store degli attuatori
+//
+typedef struct
+{
+    const char * p_name;
+    uint32_t n_slots;
+    uint32_t max_state;     // Stati ammessi 0..max_state
+    uint32_t first_slot;
+} actroute_t;
+
+typedef struct
+{
+    const actroute_t * p_route;
+    uint32_t slot;
+    uint32_t state;
+} actroute_match_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+bool actroute_parse(const actroute_t * p_table, uint32_t n_routes, const char * p_uri, actroute_match_t * p_match);
+
+#ifdef __cplusplus
+}
+#endif
+
+static inline uint32_t
+actroute_slot (const actroute_match_t * p_match)
+{
+    return p_match->p_route->first_slot + p_match->slot;
+}
+
+#endif /* ACTROUTE_H */
@@ -0,0 +1,86 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <stdint.h>
+#include <string.h>
+#include "actstore.h"
+
+#define STATE_MASK  ((1 << ACTSTORE_GEN_SHIFT) - 1)
+
+void
+actstore_init (actstore_t * p_store, uint32_t n_slots, EventGroupHandle_t h_evt, EventBits_t first_bit)
+{
+    assert((n_slots > 0) && (n_slots <= ACTSTORE_MAX_SLOTS));
+
+    memset(p_store, 0, sizeof(*p_store));
+    p_store->n_slots = n_slots;
+    p_store->h_evt = h_evt;
+    p_store->first_bit = first_bit;
+}
+
+// Piu' scrittori possono aggiornare lo stesso slot: il CAS garantisce una
+// generazione nuova per ogni scrittura e nessuno stato perso a meta'
+//
+void
+actstore_write (actstore_t * p_store, uint32_t slot, uint8_t state)
+{
+    uint32_t old = __atomic_load_n(&p_store->word[slot], __ATOMIC_RELAXED);
+    uint32_t word = 0;
+
+    do
+    {
+        word = ((old >> ACTSTORE_GEN_SHIFT) + 1) << ACTSTORE_GEN_SHIFT | state;
+    }
+    while (!__atomic_compare_exchange_n(&p_store->word[slot], &old, word, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    __atomic_fetch_add(&p_store->n_write, 1, __ATOMIC_RELAXED);
+
+    // Il bit va alzato dopo la pubblicazione: chi lo consuma legge almeno
+    // questa generazione
+    //
+    xEventGroupSetBits(p_store->h_evt, p_store->first_bit << slot);
+}
+
+// Attende almeno uno slot cambiato, poi li consuma tutti insieme. In p_state
+// lo stato corrente di ogni slot; ritorna la maschera degli slot il cui stato
+// e' davvero cambiato dall'ultima applicazione.
+//
+uint32_t
+actstore_drain (actstore_t * p_store, uint8_t * p_state, TickType_t ticks)
+{
+    EventBits_t all = p_store->first_bit * ((1 << p_store->n_slots) - 1);
+    EventBits_t bits = 0;
+    uint32_t changed = 0;
+    uint32_t word = 0;
+    uint32_t gens = 0;
+
+    bits = xEventGroupWaitBits(p_store->h_evt, all, pdTRUE, pdFALSE, ticks);
+
+    for (uint32_t slot = 0; slot < p_store->n_slots; ++slot)
+    {
+        if (bits & (p_store->first_bit << slot))
+        {
+            word = __atomic_load_n(&p_store->word[slot], __ATOMIC_ACQUIRE);
+            gens = (word >> ACTSTORE_GEN_SHIFT) - (p_store->applied[slot] >> ACTSTORE_GEN_SHIFT);
+            gens &= (UINT32_MAX >> ACTSTORE_GEN_SHIFT);
+
+            // Zero: generazione gia' letta nel giro precedente
+            //
+            if (gens != 0)
+            {
+                if ((word & STATE_MASK) != (p_store->applied[slot] & STATE_MASK))
+                {
+                    changed |= 1 << slot;
+                    p_store->n_apply++;
+                    gens--;
+                }
+
+                p_store->n_coalesced += gens;
+                p_store->applied[slot] = word;
+            }
+        }
+
+        p_state[slot] = p_store->applied[slot] & STATE_MASK;
+    }
+
+    return changed;
+}
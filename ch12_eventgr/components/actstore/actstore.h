@@ -0,0 +1,41 @@
+#ifndef ACTSTORE_H
+#define ACTSTORE_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <stdint.h>
+
+#define ACTSTORE_MAX_SLOTS  23      // Bit utili di un gruppo di eventi, meno uno
+#define ACTSTORE_GEN_SHIFT  8       // Parola di slot: generazione << 8 | stato
+
+// Stato degli attuatori fra chi scrive (handler HTTP) e un solo task che
+// applica. Ogni slot e' una parola con stato e generazione pubblicata in
+// un'unica scrittura; il bit first_bit << slot del gruppo di eventi fa da
+// segnale "slot cambiato".
+//
+typedef struct
+{
+    uint32_t word[ACTSTORE_MAX_SLOTS];
+    uint32_t applied[ACTSTORE_MAX_SLOTS];   // Ultima parola applicata, solo task applicatore
+    uint32_t n_slots;
+    EventGroupHandle_t h_evt;
+    EventBits_t first_bit;
+    uint32_t n_write;       // Scritture pubblicate
+    uint32_t n_apply;       // Cambi di stato applicati
+    uint32_t n_coalesced;   // Scritture assorbite: sovrascritte prima dell'applicazione o ridondanti
+} actstore_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+void actstore_init(actstore_t * p_store, uint32_t n_slots, EventGroupHandle_t h_evt, EventBits_t first_bit);
+void actstore_write(actstore_t * p_store, uint32_t slot, uint8_t state);
+uint32_t actstore_drain(actstore_t * p_store, uint8_t * p_state, TickType_t ticks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ACTSTORE_H */
@@ -7,10 +7,16 @@
 #include <nvs.h>
 #include <esp_vfs.h>
 #include <esp_http_server.h>
+#include <esp_timer.h>
 #include <driver/gpio.h>
+#include <soc/gpio_struct.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <unistd.h>
+#include "../components/actroute/actroute.h"
+#include "../components/actstore/actstore.h"
 
 #define WIFI_SSID   "esp32"
 #define WIFI_PSWD   "12345678"
@@ -22,14 +28,34 @@
 #define N_LEDS      3
 
 #define WIFI_RDY    (1 << 0)
-#define LED0_WAIT   (1 << 1)
-#define LED1_WAIT   (1 << 2)
-#define LED2_WAIT   (1 << 3)
+#define LED0_WAIT   (1 << 1)     // LED n: LED0_WAIT << n
 
 #define SCRATCH_BUFSIZE     (8192)
 
+// 1: URI sintetici contro il router e costo di una decodifica all'avvio
+#define ROUTE_TEST          0
+#define ROUTE_LOOPS         10000
+
+// Client WebSocket che ricevono i cambi di stato dei LED
+#define WS_MAX_CLIENTS      4
+#define WS_RX_MAX           32
+
+// {"n":s,...} per tutti i LED
+#define STATE_JSON_MAX      (2 + N_LEDS * 8)
+
 static int32_t g_leds[N_LEDS] = {GPIO_LED1, GPIO_LED2, GPIO_LED3};
-static int32_t g_led_stat[N_LEDS] = {0, 0, 0};
+static int32_t g_led_out[N_LEDS] = {0, 0, 0};      // Livelli applicati ai GPIO
+static actstore_t g_store = {0};
+static httpd_handle_t gh_server = NULL;
+static int g_ws_fds[WS_MAX_CLIENTS] = {0};          // Solo dal task del server HTTP
+static uint32_t g_n_ws = 0;
+
+static const actroute_t g_routes[] = {
+    {"led", N_LEDS, 1, 0},
+};
+
+#define N_ROUTES    (sizeof(g_routes) / sizeof(g_routes[0]))
+
 static EventGroupHandle_t gh_evt = NULL;
 static esp_netif_t * gp_wifi_ap = NULL;
 static EventGroupHandle_t g_wifi_event_group = NULL;
@@ -46,157 +72,467 @@ typedef struct
 
 esp_err_t file_server_init(void);
 
-static void
-task_server (void * p_parameter)
+static char *
+put_str (char * p_out, const char * p_str)
 {
-    EventBits_t ret = 0;
-    file_server_init();
+    while (*p_str != '\0')
+    {
+        *p_out++ = *p_str++;
+    }
 
-    for (;;)
+    return p_out;
+}
+
+static char *
+put_uint (char * p_out, uint32_t value)
+{
+    if (value >= 10)
     {
-        ret = xEventGroupWaitBits(gh_evt, LED0_WAIT | LED1_WAIT | LED2_WAIT, pdTRUE, pdFALSE, portMAX_DELAY);
+        p_out = put_uint(p_out, value / 10);
+    }
+
+    *p_out++ = '0' + (value % 10);
+
+    return p_out;
+}
+
+// Stato dei LED indicati da mask come {"0":1,"2":0}: stesso formato per la
+// risposta /status e per i cambi inviati sul WebSocket
+//
+static size_t
+render_state (char * p_buf, uint32_t mask)
+{
+    char * p_out = p_buf;
 
-        printf("azione attivata su bit %d\n", ret);
+    *p_out++ = '{';
 
-        if (LED0_WAIT & ret)
+    for (uint32_t idx = 0; idx < N_LEDS; ++idx)
+    {
+        if (0 == (mask & (1 << idx)))
         {
-            gpio_set_level(g_leds[0], g_led_stat[0]);
+            continue;
         }
-        
-        if (LED1_WAIT & ret)
+
+        if (p_out != (p_buf + 1))
         {
-            gpio_set_level(g_leds[1], g_led_stat[1]);
+            *p_out++ = ',';
         }
 
-        if (LED2_WAIT & ret)
+        *p_out++ = '"';
+        p_out = put_uint(p_out, idx);
+        p_out = put_str(p_out, "\":");
+        *p_out++ = g_led_out[idx] ? '1' : '0';
+    }
+
+    *p_out++ = '}';
+    *p_out = '\0';
+
+    return p_out - p_buf;
+}
+
+// Eseguita nel task del server HTTP alla chiusura di ogni sessione: il
+// socket esce dalla lista dei client e va chiuso qui, non dal server
+//
+static void
+ws_close (httpd_handle_t h_server, int fd)
+{
+    for (uint32_t idx = 0; idx < g_n_ws; ++idx)
+    {
+        if (g_ws_fds[idx] == fd)
         {
-            gpio_set_level(g_leds[2], g_led_stat[2]);
+            g_ws_fds[idx] = g_ws_fds[--g_n_ws];
+            break;
         }
     }
+
+    (void) close(fd);
 }
 
-static esp_err_t
-webpage_handler (httpd_req_t * p_req)
+// Eseguita nel task del server HTTP, che possiede la lista dei client: i
+// socket non piu' WebSocket o su cui l'invio fallisce vengono tolti
+//
+static void
+ws_broadcast (void * p_arg)
 {
-    esp_err_t ret = ESP_OK;     /* Valore di ritorno. */
+    char * p_msg = (char *) p_arg;
+    httpd_ws_frame_t frame = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *) p_msg,
+        .len = strlen(p_msg)
+    };
+    uint32_t idx = 0;
 
-    (void) httpd_resp_set_type(p_req, "text/html");
+    while (idx < g_n_ws)
+    {
+        if ((httpd_ws_get_fd_info(gh_server, g_ws_fds[idx]) != HTTPD_WS_CLIENT_WEBSOCKET) ||
+            (httpd_ws_send_frame_async(gh_server, g_ws_fds[idx], &frame) != ESP_OK))
+        {
+            g_ws_fds[idx] = g_ws_fds[--g_n_ws];
+            continue;
+        }
 
-    httpd_resp_sendstr_chunk(p_req, "<!DOCTYPE html><html>");
-    httpd_resp_sendstr_chunk(p_req, "<head><meta name=\"viewport\" "
-          "content=\"width=device-width, initial-scale=1\">");
-    httpd_resp_sendstr_chunk(p_req, "<link rel=\"icon\" href=\"data:,\">");
-    httpd_resp_sendstr_chunk(p_req, "<style>html { font-family: Helvetica; "
-          "display: inline-block; margin: 0px auto; "
-          "text-align: center;}");
-    httpd_resp_sendstr_chunk(p_req, ".button { background-color: "
-          "#4CAF50; border: none; color: white; "
-          "padding: 16px 40px;");
-    httpd_resp_sendstr_chunk(p_req, "text-decoration: none; "
-          "font-size: 30px; margin: 2px; cursor: pointer;}");
-    httpd_resp_sendstr_chunk(p_req, ".button2 {background-color: #555555;}"
-          "</style></head>");
-    httpd_resp_sendstr_chunk(p_req, "<body><h1>ESP32 Event Groups "
-          "(eventgr.ino)</h1>");
-
-    for (int32_t idx = 0; idx < N_LEDS; ++idx)
+        ++idx;
+    }
+
+    free(p_msg);
+}
+
+static void
+ws_notify (uint32_t mask)
+{
+    char * p_msg = NULL;
+
+    // g_n_ws letto fuori dal task HTTP: serve solo a evitare lavoro inutile
+    //
+    if ((NULL == gh_server) || (0 == g_n_ws))
+    {
+        return;
+    }
+
+    p_msg = malloc(STATE_JSON_MAX);
+
+    if (NULL == p_msg)
+    {
+        return;
+    }
+
+    render_state(p_msg, mask);
+
+    if (httpd_queue_work(gh_server, ws_broadcast, p_msg) != ESP_OK)
+    {
+        free(p_msg);
+    }
+}
+
+static void
+task_server (void * p_parameter)
+{
+    uint8_t state[N_LEDS] = {0};
+    uint32_t changed = 0;
+    uint32_t set[2] = {0};      // GPIO 0-31 e 32-39
+    uint32_t clr[2] = {0};
+    uint32_t coalesced = 0;
+
+    file_server_init();
+
+    for (;;)
     {
-        bool state = g_led_stat[idx];
-        printf("\tstato led%d = %d\n", g_leds[idx], state);
-        char temp[32] = {0};
+        changed = actstore_drain(&g_store, state, portMAX_DELAY);
 
-        snprintf(temp, sizeof temp, "<p>LED%d - State ", idx);
-        httpd_resp_sendstr_chunk(p_req, temp);
+        set[0] = set[1] = 0;
+        clr[0] = clr[1] = 0;
 
-        if (state)
+        for (uint32_t idx = 0; idx < N_LEDS; ++idx)
         {
-            httpd_resp_sendstr_chunk(p_req, "on</p>");
+            if (changed & (1 << idx))
+            {
+                g_led_out[idx] = state[idx];
+
+                if (state[idx])
+                {
+                    set[g_leds[idx] / 32] |= 1 << (g_leds[idx] % 32);
+                }
+                else
+                {
+                    clr[g_leds[idx] / 32] |= 1 << (g_leds[idx] % 32);
+                }
+            }
         }
-        else
+
+        // Tutti i LED cambiati in una scrittura per registro, nello stesso
+        // istante
+        //
+        GPIO.out_w1ts = set[0];
+        GPIO.out_w1tc = clr[0];
+
+        if ((set[1] | clr[1]) != 0)
         {
-            httpd_resp_sendstr_chunk(p_req, "off</p>");
+            GPIO.out1_w1ts.data = set[1];
+            GPIO.out1_w1tc.data = clr[1];
         }
 
-        httpd_resp_sendstr_chunk(p_req, "<p><a href=\"");
-        snprintf(temp, sizeof temp, "/led%d/%d", idx, !state);
-        httpd_resp_sendstr_chunk(p_req, temp);
-        httpd_resp_sendstr_chunk(p_req, "\"><button class=\"button\">");
-
-        if (state)
+        if (g_store.n_coalesced != coalesced)
         {
-            httpd_resp_sendstr_chunk(p_req, "OFF");
+            coalesced = g_store.n_coalesced;
+            printf("actstore: %u writes, %u applied, %u coalesced\n",
+                   g_store.n_write, g_store.n_apply, g_store.n_coalesced);
         }
-        else
+
+        // I browser ricevono qualcosa solo se un LED cambia davvero
+        //
+        if (changed != 0)
         {
-            httpd_resp_sendstr_chunk(p_req, "ON");
+            ws_notify(changed);
         }
+    }
+}
+
+// Pagina preparata a tempo di compilazione. Nella riga di ogni LED i
+// segnaposto $n (indice), $s (stato), $t (stato richiesto dal pulsante) e $b
+// (testo del pulsante) vengono sostituiti durante la copia nel buffer.
+//
+static const char g_page_head[] =
+    "<!DOCTYPE html><html>"
+    "<head><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">"
+    "<link rel=\"icon\" href=\"data:,\">"
+    "<style>html { font-family: Helvetica; display: inline-block; margin: 0px auto; "
+    "text-align: center;}"
+    ".button { background-color: #4CAF50; border: none; color: white; padding: 16px 40px;"
+    "text-decoration: none; font-size: 30px; margin: 2px; cursor: pointer;}"
+    ".button2 {background-color: #555555;}</style></head>"
+    "<body><h1>ESP32 Event Groups (eventgr.ino)</h1>";
+
+static const char g_page_row[] =
+    "<p>LED$n - State <span id=\"s$n\">$s</span></p>"
+    "<p><a id=\"a$n\" href=\"/led/$n/$t\"><button class=\"button\">$b</button></a></p>";
+
+// Niente ricarica periodica: i pulsanti inviano la richiesta senza cambiare
+// pagina e lo stato arriva dal WebSocket. All'apertura del canale si legge
+// /status per non perdere i cambi avvenuti dopo il caricamento.
+//
+static const char g_page_tail[] =
+    "<script>"
+    "function set(n,on){document.getElementById('s'+n).textContent=on?'on':'off';"
+    "var a=document.getElementById('a'+n);a.href='/led/'+n+'/'+(on?0:1);"
+    "a.firstChild.textContent=on?'OFF':'ON';}"
+    "function apply(d){for(var n in d){set(n,d[n]);}}"
+    "document.querySelectorAll('a').forEach(function(a){a.onclick=function(e){"
+    "e.preventDefault();fetch(a.getAttribute('href'));};});"
+    "function ws(){var s=new WebSocket('ws://'+location.host+'/ws');"
+    "s.onopen=function(){fetch('/status').then(function(r){return r.json();}).then(apply);};"
+    "s.onmessage=function(e){apply(JSON.parse(e.data));};"
+    "s.onclose=function(){setTimeout(ws,2000);};}"
+    "ws();"
+    "</script>"
+    "</body></html>";
+
+// Ogni segnaposto cresce al piu' di 2 caratteri ("$s" -> "off")
+//
+#define PAGE_ROW_MAX    (sizeof(g_page_row) + 8)
+
+_Static_assert(sizeof(g_page_head) + (N_LEDS * PAGE_ROW_MAX) + sizeof(g_page_tail) <= SCRATCH_BUFSIZE,
+               "page does not fit in scratch buffer");
+
+static size_t
+render_page (char * p_buf)
+{
+    char * p_out = p_buf;
+    const char * p_in = NULL;
+    bool state = false;
+
+    memcpy(p_out, g_page_head, sizeof(g_page_head) - 1);
+    p_out += sizeof(g_page_head) - 1;
 
-        httpd_resp_sendstr_chunk(p_req, "</button></a></p>");
-#if 1
-        httpd_resp_sendstr_chunk(p_req, "<script>");
-        httpd_resp_sendstr_chunk(p_req, "window.setTimeout( function() {");
-        httpd_resp_sendstr_chunk(p_req, "window.location.reload();");
-        httpd_resp_sendstr_chunk(p_req, "}, 1000);");
-        httpd_resp_sendstr_chunk(p_req, "</script>");
-#endif
-        httpd_resp_sendstr_chunk(p_req, "</body></html>");
+    for (uint32_t idx = 0; idx < N_LEDS; ++idx)
+    {
+        state = g_led_out[idx];
+
+        for (p_in = g_page_row; *p_in != '\0'; ++p_in)
+        {
+            if (*p_in != '$')
+            {
+                *p_out++ = *p_in;
+                continue;
+            }
+
+            switch (*++p_in)
+            {
+                case 'n':
+                    p_out = put_uint(p_out, idx);
+                break;
+                case 's':
+                    p_out = put_str(p_out, state ? "on" : "off");
+                break;
+                case 't':
+                    *p_out++ = state ? '0' : '1';
+                break;
+                case 'b':
+                    p_out = put_str(p_out, state ? "OFF" : "ON");
+                break;
+                default:
+                break;
+            }
+        }
     }
 
-    (void) httpd_resp_send_chunk(p_req, NULL, 0);
-    
-    return ret;
-}   /* webpage_handler() */
+    memcpy(p_out, g_page_tail, sizeof(g_page_tail) - 1);
+    p_out += sizeof(g_page_tail) - 1;
+
+    return p_out - p_buf;
+}
 
 static esp_err_t
-led0_handler (httpd_req_t * p_req)
+webpage_handler (httpd_req_t * p_req)
 {
-    esp_err_t ret = ESP_OK;     /* Valore di ritorno. */
-    printf("led0 %s\n", (char *)p_req->uri);
-    char * p_string = (char *) p_req->uri + sizeof("/led0/") - 1;
-    bool onoff = p_string[0] - '0';
+    // Il server HTTP serve una richiesta alla volta: il buffer scratch non e'
+    // mai condiviso fra due risposte
+    //
+    file_server_data_t * p_data = (file_server_data_t *) p_req->user_ctx;
+    size_t len = render_page(p_data->scratch);
 
-    printf("LED 0 = %d\n", onoff);
+    (void) httpd_resp_set_type(p_req, "text/html");
 
-    g_led_stat[0] = onoff;
+    return httpd_resp_send(p_req, p_data->scratch, len);
+}   /* webpage_handler() */
 
-    xEventGroupSetBits(gh_evt, LED0_WAIT);
-    
-    return ret;
-}   /* led0_handler() */
+static esp_err_t
+status_handler (httpd_req_t * p_req)
+{
+    file_server_data_t * p_data = (file_server_data_t *) p_req->user_ctx;
+    size_t len = render_state(p_data->scratch, (1 << N_LEDS) - 1);
+
+    (void) httpd_resp_set_type(p_req, "application/json");
+
+    return httpd_resp_send(p_req, p_data->scratch, len);
+}   /* status_handler() */
 
 static esp_err_t
-led1_handler (httpd_req_t * p_req)
+ws_handler (httpd_req_t * p_req)
 {
     esp_err_t ret = ESP_OK;     /* Valore di ritorno. */
-    printf("led1 %s\n", (char *)p_req->uri);
-    char * p_string = (char *) p_req->uri + sizeof("/led1/") - 1;
-    bool onoff = p_string[0] - '0';
+    uint8_t buf[WS_RX_MAX] = {0};
+    httpd_ws_frame_t frame = {0};
+    int fd = httpd_req_to_sockfd(p_req);
+    uint32_t idx = 0;
+
+    // Handshake: il socket entra nella lista dei client. I socket chiusi
+    // escono da ws_close(), quindi una lista piena e' davvero piena: la
+    // connessione viene rifiutata invece di restare senza aggiornamenti.
+    //
+    if (HTTP_GET == p_req->method)
+    {
+        for (idx = 0; (idx < g_n_ws) && (g_ws_fds[idx] != fd); ++idx)
+        {
+        }
 
-    printf("LED 1 = %d\n", onoff);
+        if (idx < g_n_ws)
+        {
+            return ESP_OK;
+        }
 
-    g_led_stat[1] = onoff;
+        if (g_n_ws == WS_MAX_CLIENTS)
+        {
+            printf("WebSocket: %d client, connessione rifiutata\n", WS_MAX_CLIENTS);
+            return ESP_FAIL;
+        }
+
+        g_ws_fds[g_n_ws++] = fd;
+
+        return ESP_OK;
+    }
+
+    // Il browser non invia comandi su questo canale: i frame si scartano
+    //
+    ret = httpd_ws_recv_frame(p_req, &frame, 0);
+
+    if ((ESP_OK == ret) && (frame.len > sizeof(buf)))
+    {
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    else if ((ESP_OK == ret) && (frame.len > 0))
+    {
+        frame.payload = buf;
+        ret = httpd_ws_recv_frame(p_req, &frame, sizeof(buf));
+    }
 
-    xEventGroupSetBits(gh_evt, LED1_WAIT);
-    
     return ret;
-}   /* led1_handler() */
+}   /* ws_handler() */
 
+// Un solo handler per tutti gli attuatori: aggiungere un tipo di attuatore
+// vuol dire aggiungere una riga a g_routes
+//
 static esp_err_t
-led2_handler (httpd_req_t * p_req)
+actuator_handler (httpd_req_t * p_req)
 {
-    esp_err_t ret = ESP_OK;     /* Valore di ritorno. */
-    printf("led2 %s\n", (char *)p_req->uri);
-    char * p_string = (char *) p_req->uri + sizeof("/led2/") - 1;
-    bool onoff = p_string[0] - '0';
+    actroute_match_t match = {0};
 
-    printf("LED 2 = %d\n", onoff);
+    if (!actroute_parse(g_routes, N_ROUTES, p_req->uri, &match))
+    {
+        return httpd_resp_send_err(p_req, HTTPD_404_NOT_FOUND, NULL);
+    }
 
-    g_led_stat[2] = onoff;
+    actstore_write(&g_store, actroute_slot(&match), match.state);
 
-    xEventGroupSetBits(gh_evt, LED2_WAIT);
-    
-    return ret;
-}   /* led2_handler() */
+    // Lo stato torna dal WebSocket: basta chiudere la richiesta
+    //
+    (void) httpd_resp_set_status(p_req, "204 No Content");
+
+    return httpd_resp_send(p_req, NULL, 0);
+}   /* actuator_handler() */
+
+#if ROUTE_TEST
+typedef struct
+{
+    const char * p_uri;
+    bool b_match;
+    uint32_t slot;
+    uint32_t state;
+} route_case_t;
+
+static const route_case_t g_route_cases[] = {
+    {"/led/0/1", true, 0, 1},
+    {"/led/2/0", true, 2, 0},
+    {"/led/01/1", true, 1, 1},
+    {"/led/1/1?t=123", true, 1, 1},
+    {"/led/3/1", false},
+    {"/led/1/2", false},
+    {"/led/1", false},
+    {"/led/1/", false},
+    {"/led//1", false},
+    {"/led/1/1/", false},
+    {"/led/1/1x", false},
+    {"/led/-1/1", false},
+    {"/led/4294967297/1", false},
+    {"/ledx/1/1", false},
+    {"/le/1/1", false},
+    {"/led0/1", false},
+    {"//1/1", false},
+    {"/", false},
+    {"", false},
+};
+
+#define N_ROUTE_CASES   (sizeof(g_route_cases) / sizeof(g_route_cases[0]))
+
+static void
+route_test (void)
+{
+    actroute_match_t match = {0};
+    uint32_t n_pass = 0;
+    bool b_ok = false;
+    int64_t usecs = 0;
+
+    for (uint32_t idx = 0; idx < N_ROUTE_CASES; ++idx)
+    {
+        b_ok = (actroute_parse(g_routes, N_ROUTES, g_route_cases[idx].p_uri, &match) == g_route_cases[idx].b_match);
+
+        if (b_ok && g_route_cases[idx].b_match)
+        {
+            b_ok = (match.slot == g_route_cases[idx].slot) && (match.state == g_route_cases[idx].state);
+        }
+
+        if (b_ok)
+        {
+            n_pass++;
+        }
+        else
+        {
+            printf("route: \"%s\" FAILED\n", g_route_cases[idx].p_uri);
+        }
+    }
+
+    usecs = esp_timer_get_time();
+
+    for (uint32_t idx = 0; idx < ROUTE_LOOPS; ++idx)
+    {
+        (void) actroute_parse(g_routes, N_ROUTES, "/led/2/1", &match);
+    }
+
+    usecs = esp_timer_get_time() - usecs;
+
+    printf("route: %u/%u cases passed, %lld ns per parse\n", n_pass, N_ROUTE_CASES, usecs * 1000 / ROUTE_LOOPS);
+}
+#endif /* ROUTE_TEST */
 
 esp_err_t
 file_server_init (void)
@@ -204,18 +540,16 @@ file_server_init (void)
     esp_err_t ret = ESP_FAIL;       /* Valore di ritorno della funzione. */
     static file_server_data_t * p_server_data = NULL;   /* Variabile usata da
                                                          * apposito handler. */
-    httpd_handle_t server = NULL;   /* Istanza dello handler relativo al server
-                                     * HTTP. */
     // Per configurare correttamente la struttura di base, va sempre eseguito
     // HTTPD_DEFAULT_CONFIG.
     //
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     // Dichiarazione di tutte le strutture associate alle varie chiamate HTTP.
     //
-    httpd_uri_t open_main_page;
-    httpd_uri_t open_led0;
-    httpd_uri_t open_led1;
-    httpd_uri_t open_led2;
+    httpd_uri_t open_main_page = {0};
+    httpd_uri_t open_status = {0};
+    httpd_uri_t open_ws = {0};
+    httpd_uri_t open_actuator = {0};
 
     xEventGroupWaitBits(gh_evt, WIFI_RDY, pdFALSE, pdFALSE, portMAX_DELAY);
 
@@ -245,11 +579,15 @@ file_server_init (void)
             //
             config.uri_match_fn = httpd_uri_match_wildcard;
 
+            // Chiusura delle sessioni: i socket WebSocket lasciano la lista
+            //
+            config.close_fn = ws_close;
+
             // Fa partire il server web creando una istanza HTTP e allocando
             // memoria e risorse per esso in base alla configurazione
             // specificata.
             //
-            if (httpd_start(&server, &config) != ESP_OK)
+            if (httpd_start(&gh_server, &config) != ESP_OK)
             {
                 ret = ESP_FAIL;
             }
@@ -263,25 +601,29 @@ file_server_init (void)
                 open_main_page.method = HTTP_GET;
                 open_main_page.handler = webpage_handler;
                 open_main_page.user_ctx = p_server_data;
-                ESP_ERROR_CHECK(httpd_register_uri_handler(server, &open_main_page));
-
-                open_led0.uri = "/led0/*";
-                open_led0.method = HTTP_GET;
-                open_led0.handler = led0_handler;
-                open_led0.user_ctx = p_server_data;
-                ESP_ERROR_CHECK(httpd_register_uri_handler(server, &open_led0));
-
-                open_led1.uri = "/led1/*";
-                open_led1.method = HTTP_GET;
-                open_led1.handler = led1_handler;
-                open_led1.user_ctx = p_server_data;
-                ESP_ERROR_CHECK(httpd_register_uri_handler(server, &open_led1));
-
-                open_led2.uri = "/led2/*";
-                open_led2.method = HTTP_GET;
-                open_led2.handler = led2_handler;
-                open_led2.user_ctx = p_server_data;
-                ESP_ERROR_CHECK(httpd_register_uri_handler(server, &open_led2));
+                ESP_ERROR_CHECK(httpd_register_uri_handler(gh_server, &open_main_page));
+
+                open_status.uri = "/status";
+                open_status.method = HTTP_GET;
+                open_status.handler = status_handler;
+                open_status.user_ctx = p_server_data;
+                ESP_ERROR_CHECK(httpd_register_uri_handler(gh_server, &open_status));
+
+                open_ws.uri = "/ws";
+                open_ws.method = HTTP_GET;
+                open_ws.handler = ws_handler;
+                open_ws.user_ctx = p_server_data;
+                open_ws.is_websocket = true;
+                ESP_ERROR_CHECK(httpd_register_uri_handler(gh_server, &open_ws));
+
+                // Registrato per ultimo: gli URI sono confrontati in ordine di
+                // registrazione, quelli non serviti sopra arrivano al router
+                //
+                open_actuator.uri = "/*";
+                open_actuator.method = HTTP_GET;
+                open_actuator.handler = actuator_handler;
+                open_actuator.user_ctx = p_server_data;
+                ESP_ERROR_CHECK(httpd_register_uri_handler(gh_server, &open_actuator));
 
                 ret = ESP_OK;
             }
@@ -504,12 +846,20 @@ app_main (void)
     {
         gpio_pad_select_gpio(g_leds[idx]);
         ESP_ERROR_CHECK(gpio_set_direction(g_leds[idx], GPIO_MODE_OUTPUT));
-        ESP_ERROR_CHECK(gpio_set_level(g_leds[idx], g_led_stat[idx]));
+        ESP_ERROR_CHECK(gpio_set_level(g_leds[idx], g_led_out[idx]));
     }
 
+#if ROUTE_TEST
+    route_test();
+#endif /* ROUTE_TEST */
+
     gh_evt = xEventGroupCreate();;
     assert(gh_evt != NULL);
 
+    // Slot dello store = indice del LED, segnalati dai bit LED0_WAIT << n
+    //
+    actstore_init(&g_store, N_LEDS, gh_evt, LED0_WAIT);
+
     ret = xTaskCreatePinnedToCore(task_server, "http", 2100, NULL, 1, NULL, app_cpu);
     assert(pdPASS == ret);
 
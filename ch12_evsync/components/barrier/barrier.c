@@ -0,0 +1,191 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "barrier.h"
+
+void
+barrier_init (barrier_t * p_bar, uint32_t n_parties)
+{
+    assert(n_parties > 0);
+
+    memset(p_bar, 0, sizeof(*p_bar));
+    portMUX_INITIALIZE(&p_bar->mux);
+    p_bar->n_parties = n_parties;
+}
+
+// Ritira un arrivo: se era il primo della fase, first_us passa al piu'
+// vecchio fra quelli rimasti in attesa
+//
+static void
+unlink_waiter (barrier_t * p_bar, barrier_waiter_t * p_self)
+{
+    barrier_waiter_t ** pp_node = &p_bar->p_waiters;
+    barrier_waiter_t * p_node = NULL;
+
+    while (*pp_node != p_self)
+    {
+        pp_node = &(*pp_node)->p_next;
+    }
+
+    *pp_node = p_self->p_next;
+    p_bar->n_arrived--;
+
+    if (p_self->arrived_us == p_bar->first_us)
+    {
+        for (p_node = p_bar->p_waiters; p_node != NULL; p_node = p_node->p_next)
+        {
+            if ((p_node == p_bar->p_waiters) || (p_node->arrived_us < p_bar->first_us))
+            {
+                p_bar->first_us = p_node->arrived_us;
+            }
+        }
+    }
+}
+
+static void
+release (barrier_t * p_bar, barrier_waiter_t * p_list)
+{
+    barrier_waiter_t * p_next = NULL;
+
+    // p_next va letto prima della notifica: dopo, il nodo sullo stack del
+    // destinatario puo' non esistere piu'
+    //
+    while (p_list != NULL)
+    {
+        p_next = p_list->p_next;
+        xTaskNotify(p_list->h_task, BARRIER_NFY_RELEASE, eSetBits);
+        p_list = p_next;
+    }
+}
+
+// Ritorna pdPASS quando la fase si chiude, pdFAIL allo scadere di ticks: in
+// quel caso l'arrivo viene ritirato e la fase resta aperta per gli altri.
+// In p_gen (opzionale) la generazione chiusa.
+//
+BaseType_t
+barrier_wait (barrier_t * p_bar, TickType_t ticks, uint32_t * p_gen)
+{
+    barrier_waiter_t self = {xTaskGetCurrentTaskHandle(), 0, NULL};
+    barrier_waiter_t * p_list = NULL;
+    int64_t now = esp_timer_get_time();
+    TimeOut_t timeout = {0};
+    uint32_t gen = 0;
+    uint32_t value = 0;
+    BaseType_t ret = pdPASS;
+
+    vTaskSetTimeOutState(&timeout);
+
+    taskENTER_CRITICAL(&p_bar->mux);
+    gen = p_bar->generation;
+
+    if (0 == p_bar->n_arrived)
+    {
+        p_bar->first_us = now;
+    }
+
+    if (++p_bar->n_arrived == p_bar->n_parties)
+    {
+        p_list = p_bar->p_waiters;
+        p_bar->p_waiters = NULL;
+        p_bar->n_arrived = 0;
+        p_bar->generation = gen + 1;
+        p_bar->release_us = now;
+        p_bar->n_phases++;
+        p_bar->skew_us += now - p_bar->first_us;
+
+        if ((now - p_bar->first_us) > p_bar->skew_max_us)
+        {
+            p_bar->skew_max_us = now - p_bar->first_us;
+        }
+
+        taskEXIT_CRITICAL(&p_bar->mux);
+
+        release(p_bar, p_list);
+    }
+    else
+    {
+        self.arrived_us = now;
+        self.p_next = p_bar->p_waiters;
+        p_bar->p_waiters = &self;
+        taskEXIT_CRITICAL(&p_bar->mux);
+
+        for (;;)
+        {
+            (void) xTaskNotifyWait(0, BARRIER_NFY_RELEASE, &value, ticks);
+
+            if (value & BARRIER_NFY_RELEASE)
+            {
+                break;
+            }
+
+            // Una notifica estranea non sveglia e non fa ripartire il
+            // timeout: si attende solo il tempo rimasto
+            //
+            value = 0;
+
+            if (pdFALSE == xTaskCheckForTimeOut(&timeout, &ticks))
+            {
+                continue;
+            }
+
+            taskENTER_CRITICAL(&p_bar->mux);
+
+            if (p_bar->generation == gen)
+            {
+                unlink_waiter(p_bar, &self);
+                p_bar->n_timeouts++;
+                taskEXIT_CRITICAL(&p_bar->mux);
+                ret = pdFAIL;
+                break;
+            }
+
+            taskEXIT_CRITICAL(&p_bar->mux);
+
+            // Fase chiusa mentre scadeva il timeout: la notifica e' in
+            // arrivo e va consumata prima di abbandonare il nodo
+            //
+            ticks = portMAX_DELAY;
+        }
+
+        if (pdPASS == ret)
+        {
+            now = esp_timer_get_time();
+
+            // Se la fase successiva e' gia' chiusa release_us non e' piu' la
+            // nostra: il campione si scarta
+            //
+            taskENTER_CRITICAL(&p_bar->mux);
+
+            if (((gen + 1) == p_bar->generation) && ((now - p_bar->release_us) > p_bar->wake_max_us))
+            {
+                p_bar->wake_max_us = now - p_bar->release_us;
+            }
+
+            taskEXIT_CRITICAL(&p_bar->mux);
+        }
+    }
+
+    if (p_gen != NULL)
+    {
+        *p_gen = gen;
+    }
+
+    return ret;
+}
+
+void
+barrier_print_stats (barrier_t * p_bar)
+{
+    barrier_t snap = {0};
+
+    taskENTER_CRITICAL(&p_bar->mux);
+    snap = *p_bar;
+    taskEXIT_CRITICAL(&p_bar->mux);
+
+    printf("barrier: %u parties, %u phases, %u timeouts, skew avg %lld max %lld us, wake max %lld us\n",
+           snap.n_parties, snap.n_phases, snap.n_timeouts,
+           (snap.n_phases != 0) ? (snap.skew_us / snap.n_phases) : 0, snap.skew_max_us, snap.wake_max_us);
+}
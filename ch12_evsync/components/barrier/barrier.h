@@ -0,0 +1,56 @@
+#ifndef BARRIER_H
+#define BARRIER_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdint.h>
+
+// Nodo sullo stack di chi attende: nessuna allocazione e nessun limite al
+// numero di partecipanti
+//
+typedef struct barrier_waiter
+{
+    TaskHandle_t h_task;
+    int64_t arrived_us;     // Per ricalcolare first_us se l'arrivo si ritira
+    struct barrier_waiter * p_next;
+} barrier_waiter_t;
+
+// Bit di notifica con cui l'ultimo arrivato sveglia gli altri: durante
+// barrier_wait() il valore di notifica del task appartiene alla barriera, le
+// notifiche di altri produttori non la svegliano ma vengono consumate
+//
+#define BARRIER_NFY_RELEASE (1UL << 30)
+
+// Barriera a generazioni: l'ultimo arrivato chiude la fase, incrementa la
+// generazione e notifica gli altri.
+//
+typedef struct
+{
+    portMUX_TYPE mux;
+    uint32_t n_parties;
+    uint32_t n_arrived;
+    uint32_t generation;
+    barrier_waiter_t * p_waiters;
+    int64_t first_us;       // Prima arrivata della fase corrente
+    int64_t release_us;     // Chiusura dell'ultima fase
+    uint32_t n_phases;
+    uint32_t n_timeouts;
+    int64_t skew_us;        // Somma su tutte le fasi: ultima - prima arrivata
+    int64_t skew_max_us;
+    int64_t wake_max_us;    // Ritardo massimo fra chiusura e risveglio
+} barrier_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+void barrier_init(barrier_t * p_bar, uint32_t n_parties);
+BaseType_t barrier_wait(barrier_t * p_bar, TickType_t ticks, uint32_t * p_gen);
+void barrier_print_stats(barrier_t * p_bar);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BARRIER_H */
@@ -1,29 +1,36 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <freertos/event_groups.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <driver/gpio.h>
+#include <esp_timer.h>
 #include <stdio.h>
+#include "../components/barrier/barrier.h"
 
 #define GPIO_LED1   GPIO_NUM_18
 #define GPIO_LED2   GPIO_NUM_19
 #define GPIO_LED3   GPIO_NUM_21
 
 #define N_LEDS      3
+#define N_PARTIES   (N_LEDS + 1)    // LED piu' il task che da' il passo
 
-#define EV_RDY      (1 << 3)
-#define EV_ALL      (EV_RDY | (1 << 2) | (1 << 1) | (1 << 0))
+#define STATS_PHASES    10
 
-static EventGroupHandle_t gh_evt = NULL;
+// 1: tempo di un giro di barriera al crescere dei partecipanti, su entrambi
+// i core. Ci si ferma prima di BENCH_MAX_PARTIES se la heap finisce.
+//
+#define BENCH_BARRIER       0
+#define BENCH_MAX_PARTIES   256
+#define BENCH_ROUNDS        1000
+#define BENCH_STACK         1024
+
+static barrier_t g_bar = {0};
 static int32_t g_leds[N_LEDS] = {GPIO_LED1, GPIO_LED2, GPIO_LED3};
 
 static void
 task_led (void * p_param)
 {
     uint32_t ledx = (uint32_t) p_param;
-    EventBits_t out_ev = 1 << ledx;
-    EventBits_t rev = 0;
     TickType_t timeout = 0;
     uint32_t seed = ledx;
     int32_t led_status = 0;
@@ -34,9 +41,10 @@ task_led (void * p_param)
     {
         timeout = rand_r(&seed) % 100 + 50;
 
-        rev = xEventGroupSync(gh_evt, out_ev, EV_ALL, timeout);
-
-        if (EV_ALL == (rev & EV_ALL))
+        // Allo scadere l'arrivo viene ritirato: la fase si chiude solo con
+        // tutti i LED presenti insieme
+        //
+        if (pdPASS == barrier_wait(&g_bar, timeout, NULL))
         {
             led_status = gpio_get_level(g_leds[ledx]);
             gpio_set_level(g_leds[ledx], !led_status);
@@ -51,12 +59,102 @@ task_led (void * p_param)
 static void
 task_loop (void * p_param)
 {
+    uint32_t gen = 0;
+
     for (;;)
     {
         vTaskDelay(pdMS_TO_TICKS(1000));
-        xEventGroupSetBits(gh_evt, EV_RDY);
+        barrier_wait(&g_bar, portMAX_DELAY, &gen);
+
+        if (0 == ((gen + 1) % STATS_PHASES))
+        {
+            barrier_print_stats(&g_bar);
+        }
+    }
+}
+
+#if BENCH_BARRIER
+static barrier_t g_bench_bar = {0};
+static TaskHandle_t gh_bench[BENCH_MAX_PARTIES] = {0};
+static uint32_t g_bench_done = 0;
+
+static void
+task_bench (void * p_param)
+{
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    for (uint32_t round = 0; round < BENCH_ROUNDS; ++round)
+    {
+        barrier_wait(&g_bench_bar, portMAX_DELAY, NULL);
+    }
+
+    __atomic_fetch_add(&g_bench_done, 1, __ATOMIC_RELEASE);
+    vTaskDelete(NULL);
+}
+
+// app_main partecipa a ogni giro e misura il tempo totale: un giro e' il
+// tempo fra due chiusure consecutive con tutti i task che ripartono
+//
+static void
+bench_barrier (void)
+{
+    uint32_t n_tasks = 0;
+    int64_t usecs = 0;
+    BaseType_t ret = 0;
+
+    for (uint32_t n_parties = 2; n_parties <= BENCH_MAX_PARTIES; n_parties *= 2)
+    {
+        for (n_tasks = 0; n_tasks < (n_parties - 1); ++n_tasks)
+        {
+            ret = xTaskCreatePinnedToCore(task_bench, "bench", BENCH_STACK, NULL, 1,
+                                          &gh_bench[n_tasks], n_tasks % portNUM_PROCESSORS);
+
+            if (ret != pdPASS)
+            {
+                break;
+            }
+        }
+
+        barrier_init(&g_bench_bar, n_tasks + 1);
+        __atomic_store_n(&g_bench_done, 0, __ATOMIC_RELAXED);
+
+        for (uint32_t idx = 0; idx < n_tasks; ++idx)
+        {
+            xTaskNotifyGive(gh_bench[idx]);
+        }
+
+        usecs = esp_timer_get_time();
+
+        for (uint32_t round = 0; round < BENCH_ROUNDS; ++round)
+        {
+            barrier_wait(&g_bench_bar, portMAX_DELAY, NULL);
+        }
+
+        usecs = esp_timer_get_time() - usecs;
+
+        // La barriera si riusa solo quando tutti i task ne sono usciti
+        //
+        while (__atomic_load_n(&g_bench_done, __ATOMIC_ACQUIRE) != n_tasks)
+        {
+            vTaskDelay(1);
+        }
+
+        // Stack e TCB dei task terminati li libera il task idle di ogni core
+        //
+        vTaskDelay(pdMS_TO_TICKS(50));
+
+        printf("barrier %3u parties: %lld us per round, skew avg %lld max %lld us, wake max %lld us\n",
+               n_tasks + 1, usecs / BENCH_ROUNDS,
+               g_bench_bar.skew_us / g_bench_bar.n_phases, g_bench_bar.skew_max_us, g_bench_bar.wake_max_us);
+
+        if (n_tasks < (n_parties - 1))
+        {
+            printf("barrier: out of memory at %u parties\n", n_parties);
+            break;
+        }
     }
 }
+#endif /* BENCH_BARRIER */
 
 void
 app_main (void)
@@ -64,8 +162,11 @@ app_main (void)
     int32_t app_cpu = xPortGetCoreID();
     BaseType_t ret = 0;
 
-    gh_evt = xEventGroupCreate();
-    assert(gh_evt != NULL);
+#if BENCH_BARRIER
+    bench_barrier();
+#endif /* BENCH_BARRIER */
+
+    barrier_init(&g_bar, N_PARTIES);
 
     for (int32_t idx = 0; idx < N_LEDS; ++idx)
     {
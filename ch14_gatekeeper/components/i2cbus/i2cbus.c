@@ -0,0 +1,410 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <driver/i2c.h>
+#include <esp_timer.h>
+#include <esp_err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "i2cbus.h"
+
+#define XFER_WRITE      0
+#define XFER_READ       1
+#define XFER_WRITE_READ 2
+
+#define I2CBUS_TIMEOUT  (1000 / portTICK_RATE_MS)
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t addr;
+    uint8_t flags;
+    i2cbus_client_t client;
+    const uint8_t * p_wr;
+    size_t wr_len;
+    uint8_t * p_rd;
+    size_t rd_len;
+    esp_err_t * p_ret;      // Esito, scritto dal bus manager
+    TaskHandle_t h_task;    // Task da notificare al termine
+} xfer_t;
+
+typedef struct
+{
+    const char * p_name;
+    i2cbus_prio_t prio;
+    i2cbus_stats_t stats;
+} client_t;
+
+static i2c_port_t g_port = I2C_NUM_0;
+static QueueHandle_t gh_queue[I2CBUS_N_PRIO] = {NULL};
+static TaskHandle_t gh_bus_task = NULL;
+static client_t g_clients[I2CBUS_MAX_CLIENTS] = {0};
+static int32_t g_n_clients = 0;
+static portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void task_bus(void * p_arg);
+
+esp_err_t
+i2cbus_init (const i2cbus_config_t * p_cfg)
+{
+    esp_err_t ret = ESP_OK;
+    BaseType_t rc = 0;
+    i2c_config_t conf = {
+        .mode = I2C_MODE_MASTER,
+        .sda_io_num = p_cfg->gpio_sda,
+        .scl_io_num = p_cfg->gpio_scl,
+        .sda_pullup_en = p_cfg->b_pullup ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE,
+        .scl_pullup_en = p_cfg->b_pullup ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE,
+        .master.clk_speed = p_cfg->clk_speed,
+    };
+
+    if (gh_bus_task != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    g_port = p_cfg->port;
+
+    ret = i2c_param_config(g_port, &conf);
+
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    ret = i2c_driver_install(g_port, conf.mode, 0, 0, 0);
+
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    for (uint32_t idx = 0; idx < I2CBUS_N_PRIO; ++idx)
+    {
+        gh_queue[idx] = xQueueCreate(p_cfg->q_depth, sizeof(xfer_t));
+
+        if (NULL == gh_queue[idx])
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    rc = xTaskCreatePinnedToCore(task_bus, "i2cbus", 3072, NULL, p_cfg->task_prio, &gh_bus_task, p_cfg->task_cpu);
+
+    return (pdPASS == rc) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+i2cbus_client_t
+i2cbus_client_add (const char * p_name, i2cbus_prio_t prio)
+{
+    i2cbus_client_t client = -1;
+
+    assert(prio < I2CBUS_N_PRIO);
+
+    portENTER_CRITICAL(&g_mux);
+
+    if (g_n_clients < I2CBUS_MAX_CLIENTS)
+    {
+        client = g_n_clients++;
+        g_clients[client].p_name = p_name;
+        g_clients[client].prio = prio;
+    }
+
+    portEXIT_CRITICAL(&g_mux);
+
+    return client;
+}
+
+static esp_err_t
+submit (xfer_t * p_xfer)
+{
+    esp_err_t result = ESP_FAIL;
+    uint32_t bits = 0;
+    BaseType_t ret = 0;
+
+    assert(p_xfer->client >= 0 && p_xfer->client < g_n_clients);
+    assert(gh_bus_task != NULL);
+
+    p_xfer->p_ret = &result;
+    p_xfer->h_task = xTaskGetCurrentTaskHandle();
+
+    ret = xQueueSendToBack(gh_queue[g_clients[p_xfer->client].prio], p_xfer, portMAX_DELAY);
+    assert(pdPASS == ret);
+    xTaskNotifyGive(gh_bus_task);
+
+    // La transazione vive sullo stack del chiamante: si attende sempre il
+    // completamento, il timeout e' applicato dal bus manager. Una notifica
+    // estranea non basta a tornare, conta solo il bit riservato.
+    //
+    do
+    {
+        (void) xTaskNotifyWait(0, I2CBUS_NFY_DONE, &bits, portMAX_DELAY);
+    }
+    while (0 == (bits & I2CBUS_NFY_DONE));
+
+    return result;
+}
+
+esp_err_t
+i2cbus_write (i2cbus_client_t client, uint8_t addr, const uint8_t * p_data, size_t len, uint32_t flags)
+{
+    xfer_t xfer = {0};
+
+    xfer.type = XFER_WRITE;
+    xfer.addr = addr;
+    xfer.flags = flags;
+    xfer.client = client;
+    xfer.p_wr = p_data;
+    xfer.wr_len = len;
+
+    return submit(&xfer);
+}
+
+esp_err_t
+i2cbus_read (i2cbus_client_t client, uint8_t addr, uint8_t * p_data, size_t len)
+{
+    xfer_t xfer = {0};
+
+    xfer.type = XFER_READ;
+    xfer.addr = addr;
+    xfer.client = client;
+    xfer.p_rd = p_data;
+    xfer.rd_len = len;
+
+    return submit(&xfer);
+}
+
+esp_err_t
+i2cbus_write_read (i2cbus_client_t client, uint8_t addr, const uint8_t * p_wr, size_t wr_len, uint8_t * p_rd, size_t rd_len)
+{
+    xfer_t xfer = {0};
+
+    xfer.type = XFER_WRITE_READ;
+    xfer.addr = addr;
+    xfer.client = client;
+    xfer.p_wr = p_wr;
+    xfer.wr_len = wr_len;
+    xfer.p_rd = p_rd;
+    xfer.rd_len = rd_len;
+
+    return submit(&xfer);
+}
+
+void
+i2cbus_get_stats (i2cbus_client_t client, i2cbus_stats_t * p_stats)
+{
+    assert(client >= 0 && client < g_n_clients);
+
+    portENTER_CRITICAL(&g_mux);
+    *p_stats = g_clients[client].stats;
+    portEXIT_CRITICAL(&g_mux);
+}
+
+void
+i2cbus_print_stats (void)
+{
+    i2cbus_stats_t stats = {0};
+
+    for (i2cbus_client_t idx = 0; idx < g_n_clients; ++idx)
+    {
+        i2cbus_get_stats(idx, &stats);
+        printf("i2cbus %-12s prio %d: %u xfer (%u batched), %u bytes, %u err, %llu us\n",
+               g_clients[idx].p_name, g_clients[idx].prio, stats.n_xfer, stats.n_batched,
+               stats.n_bytes, stats.n_error, stats.bus_us);
+    }
+}
+
+static bool
+batchable (const xfer_t * p_xfer)
+{
+    return (XFER_WRITE == p_xfer->type) && ((p_xfer->flags & I2CBUS_F_BATCH) != 0);
+}
+
+static esp_err_t
+execute (xfer_t * p_batch, uint32_t n_xfer)
+{
+    const xfer_t * p_xfer = &p_batch[0];
+    i2c_cmd_handle_t h_cmd = NULL;
+    esp_err_t ret = ESP_OK;
+
+    h_cmd = i2c_cmd_link_create();
+
+    if (NULL == h_cmd)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ret = i2c_master_start(h_cmd);
+
+    if (ret != ESP_OK)
+    {
+        goto exec_err;
+    }
+
+    if (p_xfer->type != XFER_READ)
+    {
+        ret = i2c_master_write_byte(h_cmd, p_xfer->addr << 1 | I2C_MASTER_WRITE, true);
+
+        if (ret != ESP_OK)
+        {
+            goto exec_err;
+        }
+
+        // Le scritture accorpate condividono START, indirizzo e STOP
+        //
+        for (uint32_t idx = 0; idx < n_xfer; ++idx)
+        {
+            ret = i2c_master_write(h_cmd, p_batch[idx].p_wr, p_batch[idx].wr_len, true);
+
+            if (ret != ESP_OK)
+            {
+                goto exec_err;
+            }
+        }
+
+        if (XFER_WRITE_READ == p_xfer->type)
+        {
+            ret = i2c_master_start(h_cmd);
+
+            if (ret != ESP_OK)
+            {
+                goto exec_err;
+            }
+        }
+    }
+
+    if (p_xfer->type != XFER_WRITE)
+    {
+        ret = i2c_master_write_byte(h_cmd, p_xfer->addr << 1 | I2C_MASTER_READ, true);
+
+        if (ret != ESP_OK)
+        {
+            goto exec_err;
+        }
+
+        ret = i2c_master_read(h_cmd, p_xfer->p_rd, p_xfer->rd_len, I2C_MASTER_LAST_NACK);
+
+        if (ret != ESP_OK)
+        {
+            goto exec_err;
+        }
+    }
+
+    ret = i2c_master_stop(h_cmd);
+
+    if (ret != ESP_OK)
+    {
+        goto exec_err;
+    }
+
+    ret = i2c_master_cmd_begin(g_port, h_cmd, I2CBUS_TIMEOUT);
+exec_err:
+    i2c_cmd_link_delete(h_cmd);
+
+    return ret;
+}
+
+static void
+account (const xfer_t * p_batch, uint32_t n_xfer, size_t total, int64_t usecs, esp_err_t ret)
+{
+    portENTER_CRITICAL(&g_mux);
+
+    for (uint32_t idx = 0; idx < n_xfer; ++idx)
+    {
+        const xfer_t * p_xfer = &p_batch[idx];
+        i2cbus_stats_t * p_stats = &g_clients[p_xfer->client].stats;
+        size_t bytes = p_xfer->wr_len + p_xfer->rd_len;
+
+        // Il tempo di una transazione accorpata e' ripartito in base ai byte
+        //
+        p_stats->bus_us += (total > 0) ? (uint64_t) usecs * bytes / total : (uint64_t) usecs;
+        p_stats->n_bytes += bytes;
+        p_stats->n_xfer++;
+
+        if (idx > 0)
+        {
+            p_stats->n_batched++;
+        }
+
+        if (ret != ESP_OK)
+        {
+            p_stats->n_error++;
+        }
+    }
+
+    portEXIT_CRITICAL(&g_mux);
+}
+
+static bool
+dequeue (xfer_t * p_xfer, i2cbus_prio_t * p_prio)
+{
+    for (uint32_t prio = 0; prio < I2CBUS_N_PRIO; ++prio)
+    {
+        if (pdPASS == xQueueReceive(gh_queue[prio], p_xfer, 0))
+        {
+            *p_prio = prio;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void
+task_bus (void * p_arg)
+{
+    static xfer_t batch[I2CBUS_BATCH_XFERS] = {0};
+    i2cbus_prio_t prio = I2CBUS_PRIO_NORMAL;
+    uint32_t n_xfer = 0;
+    size_t total = 0;
+    int64_t usecs = 0;
+    esp_err_t ret = ESP_OK;
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Una transazione per volta, ripartendo sempre dalla coda piu'
+        // prioritaria: una scrittura breve passa davanti alla pagina OLED
+        // successiva.
+        //
+        while (dequeue(&batch[0], &prio))
+        {
+            n_xfer = 1;
+            total = batch[0].wr_len + batch[0].rd_len;
+
+            while (batchable(&batch[n_xfer - 1]) && (n_xfer < I2CBUS_BATCH_XFERS))
+            {
+                xfer_t * p_next = &batch[n_xfer];
+
+                if (xQueuePeek(gh_queue[prio], p_next, 0) != pdPASS)
+                {
+                    break;
+                }
+
+                if (!batchable(p_next) || (p_next->addr != batch[0].addr) ||
+                    (total + p_next->wr_len > I2CBUS_BATCH_BYTES))
+                {
+                    break;
+                }
+
+                (void) xQueueReceive(gh_queue[prio], p_next, 0);
+                total += p_next->wr_len;
+                ++n_xfer;
+            }
+
+            usecs = esp_timer_get_time();
+            ret = execute(batch, n_xfer);
+            usecs = esp_timer_get_time() - usecs;
+
+            account(batch, n_xfer, total, usecs, ret);
+
+            for (uint32_t idx = 0; idx < n_xfer; ++idx)
+            {
+                *batch[idx].p_ret = ret;
+                xTaskNotify(batch[idx].h_task, I2CBUS_NFY_DONE, eSetBits);
+            }
+        }
+    }
+}
@@ -1,11 +1,11 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <freertos/event_groups.h>
-#include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include <driver/gpio.h>
 #include <driver/i2c.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "../components/i2cbus/i2cbus.h"
 
 #define GPIO_I2C_SDA    GPIO_NUM_25
 #define GPIO_I2C_SCL    GPIO_NUM_26
@@ -31,28 +31,23 @@
 
 #define N_DEV           2
 
-#define GATEKRDY        (1 << 0)
-#define IO_RDY          (1 << 0)
-#define IO_ERROR        (1 << 1)
-#define IO_BIT          (1 << 2)
+#define STATS_PERIOD    20
 
-#define STOP            ((int32_t) 1)
+// Client a bassa priorita': un SSD1306 aggiornato una pagina (128 byte) per
+// volta, fra una pagina e l'altra passano le scritture dei port expander
+#define OLED_EN         0
+#define OLED_ADDR       0x3C
+#define OLED_PAGES      8
+#define OLED_WIDTH      128
+#define OLED_MS         100
 
-typedef struct
-{
-    EventGroupHandle_t grpevt;
-    QueueHandle_t queue;
-    uint8_t states[N_DEV];
-} gatekeeper_t;
-
-typedef struct
-{
-    uint8_t input:1;        // 1 input, 0 output
-    uint8_t value:1;        // Valore bit (letto o da scrivere)
-    uint8_t error:1;        // 1 errore presente, 0 errore assente
-    uint8_t port:5;         // Numero della porta
-    TaskHandle_t h_task;    // Handler del task di risposta
-} ioport_t;
+// Client a raffica: task a priorita' maggiore del bus manager svegliati sullo
+// stesso tick, le loro scritture a DEV1 si accodano prima che il bus riparta e
+// vengono accorpate in una transazione (colonna "batched" delle statistiche)
+#define BURST_EN        1
+#define N_BURST         3
+#define BURST_PRIO      3
+#define BURST_MS        50
 
 typedef struct
 {
@@ -60,280 +55,173 @@ typedef struct
     uint8_t led;
 } states_t;
 
-static gatekeeper_t g_gatekeeper = {NULL, NULL, {0xFF, 0xFF}};
+static i2cbus_client_t g_client_usr1 = -1;
+static i2cbus_client_t g_client_usr2 = -1;
+#if OLED_EN
+static i2cbus_client_t g_client_oled = -1;
+#endif /* OLED_EN */
+#if BURST_EN
+static i2cbus_client_t g_client_burst[N_BURST] = {-1, -1, -1};
+static const uint8_t g_burst_port[N_BURST] = {13, 14, 15};  // Pin liberi di DEV1
+static TickType_t g_burst_start = 0;
+#endif /* BURST_EN */
+static SemaphoreHandle_t gh_states_mutex = NULL;
+static uint8_t g_states[N_DEV] = {0xFF, 0xFF};
+static const uint8_t g_i2caddr[N_DEV] = {DEV0, DEV1};
 
-static void task_gatekeeper(void * p_param);
 static void task_usr1(void * p_param);
 static void task_usr2(void * p_param);
-
-static void
-pcf8574_wait_ready (void)
-{
-    xEventGroupWaitBits(g_gatekeeper.grpevt,
-                        GATEKRDY,
-                        pdFALSE,
-                        pdFALSE,
-                        portMAX_DELAY);
-}
+#if OLED_EN
+static void task_oled(void * p_param);
+#endif /* OLED_EN */
+#if BURST_EN
+static void task_burst(void * p_param);
+#endif /* BURST_EN */
 
 static int16_t
-pcf8574_get (uint8_t port)
+pcf8574_get (i2cbus_client_t client, uint8_t port)
 {
-    static ioport_t ioport = {0};
-    uint32_t notify = 0;
-    int16_t val = 0;
-    BaseType_t ret = 0;
+    uint8_t devx = port / 8;
+    uint8_t data[1] = {0};
+    esp_err_t ret = ESP_OK;
 
     assert(port < 16);
-    ioport.input = true;
-    ioport.port = port;
-    ioport.h_task = xTaskGetCurrentTaskHandle();
 
-    pcf8574_wait_ready();
+    ret = i2cbus_read(client, g_i2caddr[devx], data, sizeof(data));
 
-    ret = xQueueSendToBack(g_gatekeeper.queue, &ioport, portMAX_DELAY);
-    assert(pdPASS == ret);
-
-    ret = xTaskNotifyWait(pdFALSE, IO_BIT | IO_ERROR | IO_RDY, &notify, portMAX_DELAY);
-    assert(pdTRUE == ret);
-
-    val = ((notify & IO_ERROR) ? -1 : !!(notify & IO_BIT));
+    if (ret != ESP_OK)
+    {
+        printf("\terrore 1\n");
+        return -1;
+    }
 
-    return val;
+    return ((data[0] >> (port % 8)) & 1);
 }
 
 static int16_t
-pcf8574_put (uint8_t port, bool value)
+pcf8574_put (i2cbus_client_t client, uint8_t port, bool value)
 {
-    ioport_t ioport = {0};
-    BaseType_t ret = 0;
-    uint32_t notify = 0;
-    int16_t val = 0;
+    uint8_t devx = port / 8;
+    uint8_t data[1] = {0};
+    bool b_stale = false;
+    esp_err_t ret = ESP_OK;
 
     assert(port < 16);
-    ioport.input = false;
-    ioport.port = port;
-    ioport.value = value;
-    ioport.h_task = xTaskGetCurrentTaskHandle();
 
-    pcf8574_wait_ready();
+    // Il mutex protegge la lettura-modifica-scrittura della copia delle uscite
+    // e la fotografia in data[], la transazione parte dopo averlo rilasciato.
+    //
+    xSemaphoreTake(gh_states_mutex, portMAX_DELAY);
 
-    ret = xQueueSendToBack(g_gatekeeper.queue, &ioport, portMAX_DELAY);
-    assert(pdPASS == ret);
+    if (value)
+    {
+        g_states[devx] |= 1 << (port % 8);
+    }
+    else
+    {
+        g_states[devx] &= ~(1 << (port % 8));
+    }
 
-    ret = xTaskNotifyWait(pdFALSE, IO_BIT | IO_ERROR | IO_RDY, &notify, portMAX_DELAY);
-    assert(pdTRUE == ret);
+    data[0] = g_states[devx];
+    xSemaphoreGive(gh_states_mutex);
 
-    val = ((notify & IO_ERROR) ? -1 : !!(notify & IO_BIT));
+    // Client di priorita' diversa possono arrivare al bus in ordine inverso
+    // rispetto alle fotografie. A scrittura completata, se la copia e' stata
+    // modificata dopo la nostra fotografia si ritrasmette lo stato corrente:
+    // una modifica successiva al controllo viene scritta dopo la nostra, quindi
+    // l'ultima scrittura trasmessa porta sempre lo stato piu' recente.
+    //
+    do
+    {
+        ret = i2cbus_write(client, g_i2caddr[devx], data, sizeof(data), I2CBUS_F_BATCH);
+
+        if (ret != ESP_OK)
+        {
+            printf("\terrore 2\n");
+            return -1;
+        }
+
+        xSemaphoreTake(gh_states_mutex, portMAX_DELAY);
+        b_stale = (data[0] != g_states[devx]);
+        data[0] = g_states[devx];
+        xSemaphoreGive(gh_states_mutex);
+    }
+    while (b_stale);
 
-    return val;
+    return value;
 }
 
 void
 app_main (void)
 {
     int32_t app_cpu = xPortGetCoreID();
-    BaseType_t ret = 0;
-
-    g_gatekeeper.grpevt = xEventGroupCreate();
-    assert(g_gatekeeper.grpevt != NULL);
-
-    ret = xTaskCreatePinnedToCore(task_gatekeeper, "gatekeeper", 2048, NULL, 2, NULL, app_cpu);
-    assert(pdPASS == ret);
-
-    ret = xTaskCreatePinnedToCore(task_usr1, "usrtask1", 2048, NULL, 1, NULL, app_cpu);
-    assert(pdPASS == ret);
-
-    ret = xTaskCreatePinnedToCore(task_usr2, "usrtask2", 2048, NULL, 1, NULL, app_cpu);
-    assert(pdPASS == ret);
-}
-
-static void
-i2c_init (int32_t gpio_sda, int32_t gpio_scl)
-{
-    i2c_config_t conf = {
-        .mode = I2C_MODE_MASTER,
-        .sda_io_num = gpio_sda,
-        .scl_io_num = gpio_scl,
-        .sda_pullup_en = GPIO_PULLUP_ENABLE,
-        .scl_pullup_en = GPIO_PULLUP_ENABLE,
-        .master.clk_speed = 100000,
+    const i2cbus_config_t cfg = {
+        .port = I2C_NUM_0,
+        .gpio_sda = GPIO_I2C_SDA,
+        .gpio_scl = GPIO_I2C_SCL,
+        .b_pullup = true,
+        .clk_speed = 100000,
+        .task_prio = 2,
+        .task_cpu = app_cpu,
+        .q_depth = 8,
     };
-
-    ESP_ERROR_CHECK(i2c_param_config(I2C_NUM_0, &conf));
-    ESP_ERROR_CHECK(i2c_driver_install(I2C_NUM_0, conf.mode, 0, 0, 0));
-}
-
-static void
-task_gatekeeper (void * p_param)
-{
-    int32_t i2caddr[N_DEV] = {DEV0, DEV1};
-    int32_t addr = 0;
-    uint8_t devx = 0;
-    uint8_t portx = 0;
-    ioport_t ioport = {0};
-    uint32_t notify = 0;
+    i2cbus_client_t client = -1;
     BaseType_t ret = 0;
 
-    g_gatekeeper.queue = xQueueCreate(8, sizeof ioport);
-    assert(g_gatekeeper.queue != NULL);
+    gh_states_mutex = xSemaphoreCreateMutex();
+    assert(gh_states_mutex != NULL);
+
+    ESP_ERROR_CHECK(i2cbus_init(&cfg));
 
-    i2c_init(GPIO_I2C_SDA, GPIO_I2C_SCL);
+    client = i2cbus_client_add("probe", I2CBUS_PRIO_LOW);
+    assert(client >= 0);
 
-    for (devx = 0; devx < N_DEV; ++devx)
+    for (uint8_t devx = 0; devx < N_DEV; ++devx)
     {
         uint8_t buffer[1] = {0xFF};
-        addr = i2caddr[devx];
-        ret = i2c_master_write_to_device(I2C_NUM_0, addr, buffer, sizeof(buffer), 1000 / portTICK_RATE_MS);
-        
-        if (ESP_OK == ret)
+        esp_err_t err = i2cbus_write(client, g_i2caddr[devx], buffer, sizeof(buffer), 0);
+
+        if (ESP_OK == err)
         {
-            printf("I2C address 0x%02X present\n", addr);
+            printf("I2C address 0x%02X present\n", g_i2caddr[devx]);
         }
         else
         {
-            printf("I2C address 0x%02X NOT RESPONDING with error %s\n", addr, esp_err_to_name(ret));
+            printf("I2C address 0x%02X NOT RESPONDING with error %s\n", g_i2caddr[devx], esp_err_to_name(err));
         }
     }
 
-    xEventGroupSetBits(g_gatekeeper.grpevt, GATEKRDY);
-
-    for (;;)
-    {
-        notify = 0;
-
-        ret = xQueueReceive(g_gatekeeper.queue, &ioport, portMAX_DELAY);
-        assert(pdPASS == ret);
-
-        devx = ioport.port / 8;
-        portx = ioport.port % 8;
-        assert(devx < N_DEV);
-        addr = i2caddr[devx];
-
-        if (ioport.input != 0)
-        {
-            uint8_t out_data[1] = {0};
-            i2c_cmd_handle_t h_cmd = i2c_cmd_link_create();
-            ret = i2c_master_start(h_cmd);
-
-            if (ret != ESP_OK)
-            {
-                goto input_err;
-            }
-
-            ret = i2c_master_write_byte(h_cmd, addr << 1 | I2C_MASTER_READ, true);
-
-            if (ret != ESP_OK)
-            {
-                goto input_err;
-            }
-
-            ret = i2c_master_read_byte(h_cmd, out_data, I2C_MASTER_NACK);
-            
-            if (ret != ESP_OK)
-            {
-                goto input_err;
-            }
-
-            ret = i2c_master_stop(h_cmd);
-
-            if (ret != ESP_OK)
-            {
-                goto input_err;
-            }
-
-            ret = i2c_master_cmd_begin(I2C_NUM_0, h_cmd, 1000 / portTICK_RATE_MS);
-input_err:
-            i2c_cmd_link_delete(h_cmd);
-            
-            if (ESP_OK == ret)
-            {
-                ioport.error = false;
-                ioport.value = ((out_data[0] >> portx) & 1 );
-            }
-            else
-            {
-                printf("\terrore 1\n");
-                ioport.error = true;
-                ioport.value = false;
-            }
-        }
-        else
-        {
-            uint8_t data[1] = {0};
-            data[0] = g_gatekeeper.states[devx];
-            
-            if (ioport.value != 0)
-            {
-                data[0] |= 1 << portx;
-            }
-            else
-            {
-                data[0] &= ~(1 << portx);
-            }
-
-            i2c_cmd_handle_t h_cmd = i2c_cmd_link_create();
-            ret = i2c_master_start(h_cmd);
+    g_client_usr1 = i2cbus_client_add("usrtask1", I2CBUS_PRIO_NORMAL);
+    assert(g_client_usr1 >= 0);
+    g_client_usr2 = i2cbus_client_add("usrtask2", I2CBUS_PRIO_HIGH);
+    assert(g_client_usr2 >= 0);
 
-            if (ret != ESP_OK)
-            {
-                goto output_err;
-            }
-
-            ret = i2c_master_write_byte(h_cmd, addr << 1 | I2C_MASTER_WRITE, true);
-
-            if (ret != ESP_OK)
-            {
-                goto output_err;
-            }
-
-            ret = i2c_master_write_byte(h_cmd, data[0], true);
-
-            if (ret != ESP_OK)
-            {
-                goto output_err;
-            }
-
-            ret = i2c_master_stop(h_cmd);
-
-            if (ret != ESP_OK)
-            {
-                goto output_err;
-            }
+    ret = xTaskCreatePinnedToCore(task_usr1, "usrtask1", 2048, NULL, 1, NULL, app_cpu);
+    assert(pdPASS == ret);
 
-            ret = i2c_master_cmd_begin(I2C_NUM_0, h_cmd, 1000 / portTICK_RATE_MS);
-output_err:
-            i2c_cmd_link_delete(h_cmd);
+    ret = xTaskCreatePinnedToCore(task_usr2, "usrtask2", 2048, NULL, 1, NULL, app_cpu);
+    assert(pdPASS == ret);
 
-            if (ESP_OK == ret)
-            {
-                ioport.error = 0;
-                g_gatekeeper.states[devx] = data[0];
-            }
-            else
-            {
-                printf("\terrore 2\n");
-                ioport.error = 1;
-            }
-        }
+#if OLED_EN
+    g_client_oled = i2cbus_client_add("oled", I2CBUS_PRIO_LOW);
+    assert(g_client_oled >= 0);
 
-        notify = IO_RDY;
+    ret = xTaskCreatePinnedToCore(task_oled, "oled", 2048, NULL, 1, NULL, app_cpu);
+    assert(pdPASS == ret);
+#endif /* OLED_EN */
 
-        if (1 == ioport.error)
-        {
-            notify |= IO_ERROR;
-        }
+#if BURST_EN
+    g_burst_start = xTaskGetTickCount();
 
-        if (ioport.value != 0)
-        {
-            notify |= IO_BIT;
-        }
+    for (uint32_t idx = 0; idx < N_BURST; ++idx)
+    {
+        g_client_burst[idx] = i2cbus_client_add("burst", I2CBUS_PRIO_NORMAL);
+        assert(g_client_burst[idx] >= 0);
 
-        if (ioport.h_task != NULL)
-        {
-            xTaskNotify(ioport.h_task, notify, eSetValueWithOverwrite);
-        }
+        ret = xTaskCreatePinnedToCore(task_burst, "burst", 2048, (void *) idx, BURST_PRIO, NULL, app_cpu);
+        assert(pdPASS == ret);
     }
+#endif /* BURST_EN */
 }
 
 static void
@@ -346,7 +234,7 @@ task_usr1 (void * p_param)
 
     for (uint32_t idx = 0; idx < N_BUTTON; ++idx)
     {
-        ret = pcf8574_put(states[idx].led, true);
+        ret = pcf8574_put(g_client_usr1, states[idx].led, true);
         assert(ret != -1);
     }
 
@@ -354,9 +242,9 @@ task_usr1 (void * p_param)
     {
         for (uint32_t idx = 0; idx < N_BUTTON; ++idx)
         {
-            ret = pcf8574_get(states[idx].button);
+            ret = pcf8574_get(g_client_usr1, states[idx].button);
             assert(ret != -1);
-            ret = pcf8574_put(states[idx].led, ret & 1);
+            ret = pcf8574_put(g_client_usr1, states[idx].led, ret & 1);
             assert(ret != -1);
         }
     }
@@ -366,14 +254,95 @@ static void
 task_usr2 (void * p_param)
 {
     bool state = false;
+    uint32_t count = 0;
     int16_t ret;
 
     for (;;)
     {
         vTaskDelay(pdMS_TO_TICKS(500));
-        ret = pcf8574_get(LED3);
+        ret = pcf8574_get(g_client_usr2, LED3);
         assert(ret != -1);
         state = !(ret & 1);
-        pcf8574_put(LED3, state);
+        pcf8574_put(g_client_usr2, LED3, state);
+
+        if (0 == (++count % STATS_PERIOD))
+        {
+            i2cbus_print_stats();
+        }
+    }
+}
+
+#if OLED_EN
+static void
+task_oled (void * p_param)
+{
+    // Display off, charge pump, page addressing, remap, display on
+    static const uint8_t init[] = {0x00, 0xAE, 0x8D, 0x14, 0x20, 0x02, 0xA1, 0xC8, 0xAF};
+    static uint8_t data[1 + OLED_WIDTH] = {0x40};
+    uint8_t cmd[4] = {0x00, 0xB0, 0x00, 0x10};
+    uint32_t frame = 0;
+    esp_err_t ret = ESP_OK;
+
+    ret = i2cbus_write(g_client_oled, OLED_ADDR, init, sizeof(init), 0);
+
+    if (ret != ESP_OK)
+    {
+        printf("OLED 0x%02X NOT RESPONDING with error %s\n", OLED_ADDR, esp_err_to_name(ret));
+        vTaskDelete(NULL);
     }
-}
\ No newline at end of file
+
+    for (;;)
+    {
+        // Una barra verticale che scorre: ogni pagina e' una transazione
+        // separata, cosi' il bus manager puo' servire le code piu' prioritarie
+        // fra una pagina e la successiva.
+        //
+        for (uint8_t page = 0; page < OLED_PAGES; ++page)
+        {
+            for (uint32_t col = 0; col < OLED_WIDTH; ++col)
+            {
+                data[1 + col] = (col == frame % OLED_WIDTH) ? 0xFF : 0x00;
+            }
+
+            cmd[1] = 0xB0 | page;
+            ret = i2cbus_write(g_client_oled, OLED_ADDR, cmd, sizeof(cmd), 0);
+
+            if (ESP_OK == ret)
+            {
+                ret = i2cbus_write(g_client_oled, OLED_ADDR, data, sizeof(data), 0);
+            }
+
+            if (ret != ESP_OK)
+            {
+                printf("\terrore 3\n");
+            }
+        }
+
+        ++frame;
+        vTaskDelay(pdMS_TO_TICKS(OLED_MS));
+    }
+}
+#endif /* OLED_EN */
+
+#if BURST_EN
+static void
+task_burst (void * p_param)
+{
+    uint32_t idx = (uint32_t) p_param;
+    TickType_t wake = g_burst_start;
+    bool state = false;
+    int16_t ret = 0;
+
+    // Tutti i task ripartono sullo stesso tick: con priorita' maggiore del bus
+    // manager ciascuno accoda la propria scrittura e si blocca, il bus trova
+    // le richieste allo stesso indirizzo gia' in coda e le accorpa.
+    //
+    for (;;)
+    {
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(BURST_MS));
+        state = !state;
+        ret = pcf8574_put(g_client_burst[idx], g_burst_port[idx], state);
+        assert(ret != -1);
+    }
+}
+#endif /* BURST_EN */
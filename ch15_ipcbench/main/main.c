@@ -0,0 +1,573 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/event_groups.h>
+#include <esp_cpu.h>
+#include <sdkconfig.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N_SAMPLES       1000        // Round trip misurati nel ping-pong
+#define N_ROUNDS        500         // Round di fan-in / fan-out
+#define N_LOCKS         2000        // Prese del mutex per task
+#define N_PEERS         4           // Task periferici in fan-in / fan-out
+#define PEER_STACK      2048
+#define BENCH_PRIO      2
+
+#define CYCLES_TO_NS(c) ((uint32_t) ((uint64_t) (c) * 1000 / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ))
+
+typedef enum
+{
+    PRIM_QUEUE = 0,     // ch3
+    PRIM_CSEM,          // ch5
+    PRIM_MAILBOX,       // ch6, coda di lunghezza 1 con xQueueOverwrite
+    PRIM_QSET,          // ch10
+    PRIM_NOTIFY,        // ch11
+    PRIM_EVGRP,         // ch12
+    N_PRIM
+} prim_t;
+
+typedef enum
+{
+    WL_PINGPONG = 0,
+    WL_FANIN,
+    WL_FANOUT,
+    N_WL
+} workload_t;
+
+typedef struct
+{
+    prim_t prim;
+    QueueHandle_t h_queue;
+    QueueSetHandle_t h_qset;
+    EventGroupHandle_t h_evgrp;
+    TaskHandle_t h_rx;      // Task ricevente, solo per le notifiche
+} chan_t;
+
+typedef struct
+{
+    chan_t * p_chan;
+    SemaphoreHandle_t h_go;
+    SemaphoreHandle_t h_ack;
+    volatile bool * p_stop;
+    uint32_t idx;
+} peer_t;
+
+typedef struct
+{
+    chan_t ping;
+    chan_t pong;
+    SemaphoreHandle_t h_ack;
+    volatile bool b_stop;
+} pingpong_t;
+
+typedef struct
+{
+    SemaphoreHandle_t h_mutex;
+    SemaphoreHandle_t h_done;
+    uint32_t * p_samples;
+} locker_t;
+
+static const char * const g_prim_names[N_PRIM] = {
+    "queue", "csem", "mailbox", "qset", "notify", "evgroup"
+};
+
+static const char * const g_wl_names[N_WL] = {
+    "pingpong", "fanin", "fanout"
+};
+
+static uint32_t g_samples[N_SAMPLES] = {0};
+static int32_t g_app_cpu = 0;
+
+static void
+chan_create (chan_t * p_chan, prim_t prim)
+{
+    memset(p_chan, 0, sizeof(*p_chan));
+    p_chan->prim = prim;
+
+    switch (prim)
+    {
+        case PRIM_QUEUE:
+            p_chan->h_queue = xQueueCreate(N_PEERS, sizeof(uint32_t));
+            assert(p_chan->h_queue != NULL);
+        break;
+
+        case PRIM_CSEM:
+            p_chan->h_queue = xSemaphoreCreateCounting(N_PEERS, 0);
+            assert(p_chan->h_queue != NULL);
+        break;
+
+        case PRIM_MAILBOX:
+            p_chan->h_queue = xQueueCreate(1, sizeof(uint32_t));
+            assert(p_chan->h_queue != NULL);
+        break;
+
+        case PRIM_QSET:
+            p_chan->h_queue = xQueueCreate(N_PEERS, sizeof(uint32_t));
+            assert(p_chan->h_queue != NULL);
+            p_chan->h_qset = xQueueCreateSet(N_PEERS);
+            assert(p_chan->h_qset != NULL);
+            xQueueAddToSet(p_chan->h_queue, p_chan->h_qset);
+        break;
+
+        case PRIM_EVGRP:
+            p_chan->h_evgrp = xEventGroupCreate();
+            assert(p_chan->h_evgrp != NULL);
+        break;
+
+        default:
+        break;
+    }
+}
+
+static void
+chan_delete (chan_t * p_chan)
+{
+    if (p_chan->h_qset != NULL)
+    {
+        xQueueReset(p_chan->h_queue);
+        xQueueRemoveFromSet(p_chan->h_queue, p_chan->h_qset);
+        vQueueDelete(p_chan->h_qset);
+    }
+
+    if (p_chan->h_queue != NULL)
+    {
+        vQueueDelete(p_chan->h_queue);
+    }
+
+    if (p_chan->h_evgrp != NULL)
+    {
+        vEventGroupDelete(p_chan->h_evgrp);
+    }
+}
+
+// Il ricevente si registra prima che il mittente inizi a inviare
+static void
+chan_bind (chan_t * p_chan)
+{
+    p_chan->h_rx = xTaskGetCurrentTaskHandle();
+}
+
+static void
+chan_send (chan_t * p_chan, uint32_t idx)
+{
+    switch (p_chan->prim)
+    {
+        case PRIM_QUEUE:
+        case PRIM_QSET:
+            xQueueSendToBack(p_chan->h_queue, &idx, portMAX_DELAY);
+        break;
+
+        case PRIM_CSEM:
+            xSemaphoreGive(p_chan->h_queue);
+        break;
+
+        case PRIM_MAILBOX:
+            xQueueOverwrite(p_chan->h_queue, &idx);
+        break;
+
+        case PRIM_NOTIFY:
+            xTaskNotifyGive(p_chan->h_rx);
+        break;
+
+        case PRIM_EVGRP:
+            xEventGroupSetBits(p_chan->h_evgrp, 1 << idx);
+        break;
+
+        default:
+        break;
+    }
+}
+
+// Riceve n segnali. I gruppi di eventi non contano: nel fan-in ogni
+// mittente usa il proprio bit e si attendono tutti i bit insieme.
+//
+static void
+chan_recv (chan_t * p_chan, uint32_t n)
+{
+    uint32_t value = 0;
+
+    if (PRIM_EVGRP == p_chan->prim)
+    {
+        xEventGroupWaitBits(p_chan->h_evgrp, (1 << n) - 1, pdTRUE, pdTRUE, portMAX_DELAY);
+        return;
+    }
+
+    for (uint32_t idx = 0; idx < n; ++idx)
+    {
+        switch (p_chan->prim)
+        {
+            case PRIM_QUEUE:
+            case PRIM_MAILBOX:
+                xQueueReceive(p_chan->h_queue, &value, portMAX_DELAY);
+            break;
+
+            case PRIM_CSEM:
+                xSemaphoreTake(p_chan->h_queue, portMAX_DELAY);
+            break;
+
+            case PRIM_QSET:
+                xQueueSelectFromSet(p_chan->h_qset, portMAX_DELAY);
+                xQueueReceive(p_chan->h_queue, &value, 0);
+            break;
+
+            case PRIM_NOTIFY:
+                ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+            break;
+
+            default:
+            break;
+        }
+    }
+}
+
+static int
+cmp_u32 (const void * p_a, const void * p_b)
+{
+    uint32_t a = *(const uint32_t *) p_a;
+    uint32_t b = *(const uint32_t *) p_b;
+
+    return (a > b) - (a < b);
+}
+
+static void
+report (const char * p_name, const char * p_wl, bool b_cross, uint32_t n_ops, uint32_t cycles,
+        const char * p_unit, uint32_t n_samples)
+{
+    uint64_t ops_s = (uint64_t) n_ops * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * 1000000 / (cycles ? cycles : 1);
+
+    printf("%-8s %-8s %-5s ops/s=%-8llu", p_name, p_wl, b_cross ? "cross" : "same", ops_s);
+
+    if (n_samples > 0)
+    {
+        qsort(g_samples, n_samples, sizeof(g_samples[0]), cmp_u32);
+        printf(" %s p50=%u p90=%u p99=%u max=%u", p_unit,
+               CYCLES_TO_NS(g_samples[n_samples / 2]),
+               CYCLES_TO_NS(g_samples[n_samples * 9 / 10]),
+               CYCLES_TO_NS(g_samples[n_samples * 99 / 100]),
+               CYCLES_TO_NS(g_samples[n_samples - 1]));
+    }
+
+    printf("\n");
+}
+
+// I task periferici terminano da soli quando vedono b_stop: non si cancella
+// mai un task che potrebbe essere in esecuzione sull'altro core.
+//
+static void
+task_echo (void * p_arg)
+{
+    pingpong_t * p_pp = (pingpong_t *) p_arg;
+
+    chan_bind(&p_pp->ping);
+    xSemaphoreGive(p_pp->h_ack);
+
+    for (;;)
+    {
+        chan_recv(&p_pp->ping, 1);
+
+        if (p_pp->b_stop)
+        {
+            break;
+        }
+
+        chan_send(&p_pp->pong, 0);
+    }
+
+    xSemaphoreGive(p_pp->h_ack);
+    vTaskDelete(NULL);
+}
+
+static void
+task_producer (void * p_arg)
+{
+    peer_t * p_peer = (peer_t *) p_arg;
+
+    xSemaphoreGive(p_peer->h_ack);
+
+    for (;;)
+    {
+        xSemaphoreTake(p_peer->h_go, portMAX_DELAY);
+
+        if (*p_peer->p_stop)
+        {
+            break;
+        }
+
+        chan_send(p_peer->p_chan, p_peer->idx);
+    }
+
+    xSemaphoreGive(p_peer->h_ack);
+    vTaskDelete(NULL);
+}
+
+static void
+task_consumer (void * p_arg)
+{
+    peer_t * p_peer = (peer_t *) p_arg;
+
+    chan_bind(p_peer->p_chan);
+    xSemaphoreGive(p_peer->h_ack);
+
+    for (;;)
+    {
+        chan_recv(p_peer->p_chan, 1);
+        xSemaphoreGive(p_peer->h_ack);
+
+        if (*p_peer->p_stop)
+        {
+            break;
+        }
+    }
+
+    vTaskDelete(NULL);
+}
+
+static void
+bench_pingpong (prim_t prim, bool b_cross)
+{
+    static pingpong_t pp = {0};
+    uint32_t t0 = 0;
+    uint32_t total = 0;
+    BaseType_t ret = 0;
+
+    chan_create(&pp.ping, prim);
+    chan_create(&pp.pong, prim);
+    chan_bind(&pp.pong);
+    pp.b_stop = false;
+    pp.h_ack = xSemaphoreCreateBinary();
+    assert(pp.h_ack != NULL);
+
+    ret = xTaskCreatePinnedToCore(task_echo, "echo", PEER_STACK, &pp, BENCH_PRIO,
+                                  NULL, b_cross ? !g_app_cpu : g_app_cpu);
+    assert(pdPASS == ret);
+    xSemaphoreTake(pp.h_ack, portMAX_DELAY);
+
+    for (uint32_t idx = 0; idx < N_SAMPLES; ++idx)
+    {
+        t0 = esp_cpu_get_ccount();
+        chan_send(&pp.ping, 0);
+        chan_recv(&pp.pong, 1);
+        g_samples[idx] = esp_cpu_get_ccount() - t0;
+        total += g_samples[idx];
+    }
+
+    pp.b_stop = true;
+    chan_send(&pp.ping, 0);
+    xSemaphoreTake(pp.h_ack, portMAX_DELAY);
+
+    vSemaphoreDelete(pp.h_ack);
+    chan_delete(&pp.ping);
+    chan_delete(&pp.pong);
+
+    // Ogni round trip sono due operazioni di segnalazione
+    report(g_prim_names[prim], g_wl_names[WL_PINGPONG], b_cross, 2 * N_SAMPLES, total, "rtt_ns", N_SAMPLES);
+}
+
+static void
+bench_fan (prim_t prim, workload_t wl, bool b_cross)
+{
+    static chan_t chans[N_PEERS] = {0};
+    static peer_t peers[N_PEERS] = {0};
+    static volatile bool b_stop = false;
+    SemaphoreHandle_t h_ack = NULL;
+    uint32_t t0 = 0;
+    uint32_t n_chan = (WL_FANIN == wl) ? 1 : N_PEERS;
+    BaseType_t ret = 0;
+
+    h_ack = xSemaphoreCreateCounting(N_PEERS, 0);
+    assert(h_ack != NULL);
+    b_stop = false;
+
+    for (uint32_t idx = 0; idx < n_chan; ++idx)
+    {
+        chan_create(&chans[idx], prim);
+    }
+
+    // Il consumatore del fan-in e' questo task
+    chan_bind(&chans[0]);
+
+    for (uint32_t idx = 0; idx < N_PEERS; ++idx)
+    {
+        peers[idx].p_chan = &chans[(WL_FANIN == wl) ? 0 : idx];
+        peers[idx].h_ack = h_ack;
+        peers[idx].idx = idx;
+        peers[idx].p_stop = &b_stop;
+        peers[idx].h_go = xSemaphoreCreateBinary();
+        assert(peers[idx].h_go != NULL);
+
+        ret = xTaskCreatePinnedToCore((WL_FANIN == wl) ? task_producer : task_consumer, "peer", PEER_STACK,
+                                      &peers[idx], BENCH_PRIO, NULL, b_cross ? !g_app_cpu : g_app_cpu);
+        assert(pdPASS == ret);
+    }
+
+    for (uint32_t idx = 0; idx < N_PEERS; ++idx)
+    {
+        xSemaphoreTake(h_ack, portMAX_DELAY);
+    }
+
+    t0 = esp_cpu_get_ccount();
+
+    for (uint32_t round = 0; round < N_ROUNDS; ++round)
+    {
+        if (WL_FANIN == wl)
+        {
+            for (uint32_t idx = 0; idx < N_PEERS; ++idx)
+            {
+                xSemaphoreGive(peers[idx].h_go);
+            }
+
+            chan_recv(&chans[0], N_PEERS);
+        }
+        else
+        {
+            for (uint32_t idx = 0; idx < N_PEERS; ++idx)
+            {
+                chan_send(&chans[idx], 0);
+            }
+
+            for (uint32_t idx = 0; idx < N_PEERS; ++idx)
+            {
+                xSemaphoreTake(h_ack, portMAX_DELAY);
+            }
+        }
+    }
+
+    t0 = esp_cpu_get_ccount() - t0;
+    b_stop = true;
+
+    for (uint32_t idx = 0; idx < N_PEERS; ++idx)
+    {
+        if (WL_FANIN == wl)
+        {
+            xSemaphoreGive(peers[idx].h_go);
+        }
+        else
+        {
+            chan_send(&chans[idx], 0);
+        }
+    }
+
+    for (uint32_t idx = 0; idx < N_PEERS; ++idx)
+    {
+        xSemaphoreTake(h_ack, portMAX_DELAY);
+    }
+
+    for (uint32_t idx = 0; idx < N_PEERS; ++idx)
+    {
+        vSemaphoreDelete(peers[idx].h_go);
+    }
+
+    for (uint32_t idx = 0; idx < n_chan; ++idx)
+    {
+        chan_delete(&chans[idx]);
+    }
+
+    vSemaphoreDelete(h_ack);
+
+    report(g_prim_names[prim], g_wl_names[wl], b_cross, N_PEERS * N_ROUNDS, t0, NULL, 0);
+}
+
+static void
+task_locker (void * p_arg)
+{
+    locker_t * p_lock = (locker_t *) p_arg;
+    uint32_t t0 = 0;
+
+    for (uint32_t idx = 0; idx < N_LOCKS; ++idx)
+    {
+        t0 = esp_cpu_get_ccount();
+        xSemaphoreTake(p_lock->h_mutex, portMAX_DELAY);
+
+        if ((p_lock->p_samples != NULL) && (idx < N_SAMPLES))
+        {
+            p_lock->p_samples[idx] = esp_cpu_get_ccount() - t0;
+        }
+
+        xSemaphoreGive(p_lock->h_mutex);
+        taskYIELD();
+    }
+
+    xSemaphoreGive(p_lock->h_done);
+    vTaskDelete(NULL);
+}
+
+// ch8: due task si contendono lo stesso mutex, si misura l'attesa in take
+static void
+bench_mutex (bool b_cross)
+{
+    static locker_t lockers[2] = {0};
+    SemaphoreHandle_t h_mutex = xSemaphoreCreateMutex();
+    SemaphoreHandle_t h_done = xSemaphoreCreateCounting(2, 0);
+    uint32_t t0 = 0;
+    BaseType_t ret = 0;
+
+    assert(h_mutex != NULL);
+    assert(h_done != NULL);
+
+    t0 = esp_cpu_get_ccount();
+
+    for (uint32_t idx = 0; idx < 2; ++idx)
+    {
+        lockers[idx].h_mutex = h_mutex;
+        lockers[idx].h_done = h_done;
+        lockers[idx].p_samples = (0 == idx) ? g_samples : NULL;
+
+        ret = xTaskCreatePinnedToCore(task_locker, "locker", PEER_STACK, &lockers[idx], BENCH_PRIO - 1,
+                                      NULL, (b_cross && idx) ? !g_app_cpu : g_app_cpu);
+        assert(pdPASS == ret);
+    }
+
+    xSemaphoreTake(h_done, portMAX_DELAY);
+    xSemaphoreTake(h_done, portMAX_DELAY);
+    t0 = esp_cpu_get_ccount() - t0;
+
+    vSemaphoreDelete(h_mutex);
+    vSemaphoreDelete(h_done);
+
+    report("mutex", "lock", b_cross, 2 * N_LOCKS, t0, "take_ns", N_SAMPLES);
+}
+
+static void
+task_bench (void * p_arg)
+{
+    printf("# ipcbench v1 cpu_mhz=%u samples=%u rounds=%u peers=%u\n",
+           CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, N_SAMPLES, N_ROUNDS, N_PEERS);
+
+    for (uint32_t cross = 0; cross < 2; ++cross)
+    {
+        for (prim_t prim = 0; prim < N_PRIM; ++prim)
+        {
+            bench_pingpong(prim, cross);
+
+            // Una mailbox sovrascrive: con piu' mittenti perde segnali
+            if (prim != PRIM_MAILBOX)
+            {
+                bench_fan(prim, WL_FANIN, cross);
+            }
+
+            bench_fan(prim, WL_FANOUT, cross);
+        }
+
+        bench_mutex(cross);
+    }
+
+    printf("# done\n");
+    vTaskDelete(NULL);
+}
+
+void
+app_main (void)
+{
+    BaseType_t ret = 0;
+
+    g_app_cpu = xPortGetCoreID();
+
+    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    ret = xTaskCreatePinnedToCore(task_bench, "bench", 4096, NULL, BENCH_PRIO, NULL, g_app_cpu);
+    assert(pdPASS == ret);
+}
@@ -0,0 +1,340 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/timers.h>
+#include <driver/gpio.h>
+#include <soc/gpio_struct.h>
+#include <esp_timer.h>
+#include <esp_err.h>
+#include <stdint.h>
+#include <string.h>
+#include "vdebounce.h"
+
+static void
+emit (vdebounce_t * p_deb)
+{
+    vdebounce_event_t evt = {0};
+
+    if (0 == p_deb->pending)
+    {
+        return;
+    }
+
+    // L'evento porta sempre lo stato completo: se la coda e' piena i fronti
+    // restano in sospeso e vengono accodati al campione successivo.
+    //
+    evt.changed = p_deb->pending;
+    evt.state = p_deb->state;
+
+    if (pdPASS == xQueueSendToBack(p_deb->cfg.h_queue, &evt, 0))
+    {
+        p_deb->pending = 0;
+    }
+    else
+    {
+        p_deb->n_overflow++;
+    }
+}
+
+static void
+sample (void * p_arg)
+{
+    vdebounce_t * p_deb = (vdebounce_t *) p_arg;
+    uint32_t level = 0;
+    uint32_t delta = 0;
+
+    // Una sola lettura del registro per tutte le 32 linee
+    //
+    level = (GPIO.in ^ p_deb->cfg.active_low) & p_deb->cfg.mask;
+    delta = level ^ p_deb->state;
+
+    // Contatore verticale: ogni linea ha un contatore a 2 bit distribuito su
+    // cnt0/cnt1, azzerato quando il campione coincide con lo stato filtrato.
+    // Lo stato commuta solo dopo 4 campioni consecutivi diversi.
+    //
+    p_deb->cnt0 = ~(p_deb->cnt0 & delta);
+    p_deb->cnt1 = p_deb->cnt0 ^ (p_deb->cnt1 & delta);
+    delta &= p_deb->cnt0 & p_deb->cnt1;
+    p_deb->state ^= delta;
+    p_deb->pending |= delta;
+
+    emit(p_deb);
+}
+
+static void IRAM_ATTR
+isr_edge (void * p_arg)
+{
+    vdebounce_lane_t * p_lane = (vdebounce_lane_t *) p_arg;
+    vdebounce_t * p_deb = p_lane->p_deb;
+    BaseType_t woken = pdFALSE;
+
+    // Il primo fronte spegne l'interrupt della linea: i rimbalzi successivi
+    // non generano altri interrupt, il timer ne conferma il livello.
+    //
+    gpio_intr_disable(p_lane->gpio);
+
+    portENTER_CRITICAL_ISR(&p_deb->mux);
+    p_deb->armed |= BIT(p_lane->gpio);
+    p_deb->seen &= ~BIT(p_lane->gpio);
+    portEXIT_CRITICAL_ISR(&p_deb->mux);
+
+    // Coda comandi del timer piena: la linea resta armata ma torna sotto
+    // interrupt, il fronte successivo riprova a riarmare la conferma.
+    //
+    if (xTimerResetFromISR(p_deb->h_confirm, &woken) != pdPASS)
+    {
+        gpio_intr_enable(p_lane->gpio);
+    }
+
+    if (woken != 0)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+static void
+lanes_intr (uint32_t lanes, bool b_enable)
+{
+    for (uint32_t gpio = 0; lanes != 0; ++gpio, lanes >>= 1)
+    {
+        if (lanes & 1)
+        {
+            (void) (b_enable ? gpio_intr_enable(gpio) : gpio_intr_disable(gpio));
+        }
+    }
+}
+
+static void
+confirm (TimerHandle_t h_timer)
+{
+    vdebounce_t * p_deb = (vdebounce_t *) pvTimerGetTimerID(h_timer);
+    uint32_t level = 0;
+    uint32_t stable = 0;
+    uint32_t delta = 0;
+    uint32_t missed = 0;
+    uint32_t armed = 0;
+
+    level = (GPIO.in ^ p_deb->cfg.active_low) & p_deb->cfg.mask;
+
+    // Una linea e' stabile se due letture consecutive del timer coincidono
+    //
+    portENTER_CRITICAL(&p_deb->mux);
+    stable = p_deb->armed & p_deb->seen & ~(level ^ p_deb->prev);
+    p_deb->seen |= p_deb->armed;
+    p_deb->prev = level;
+    p_deb->armed &= ~stable;
+    p_deb->seen &= ~stable;
+    portEXIT_CRITICAL(&p_deb->mux);
+
+    delta = (level ^ p_deb->state) & stable;
+    p_deb->state ^= delta;
+    p_deb->pending |= delta;
+
+    lanes_intr(stable, true);
+
+    // Un fronte fra la lettura e la riabilitazione dell'interrupt andrebbe
+    // perso: si rilegge e si riarma la conferma per le linee cambiate.
+    //
+    level = (GPIO.in ^ p_deb->cfg.active_low) & p_deb->cfg.mask;
+    missed = (level ^ p_deb->state) & stable;
+    lanes_intr(missed, false);
+
+    portENTER_CRITICAL(&p_deb->mux);
+    p_deb->armed |= missed;
+    armed = p_deb->armed;
+    portEXIT_CRITICAL(&p_deb->mux);
+
+    emit(p_deb);
+
+    if ((armed != 0) || (p_deb->pending != 0))
+    {
+        if (xTimerReset(p_deb->h_confirm, 0) != pdPASS)
+        {
+            // Senza conferma le linee armate resterebbero senza interrupt:
+            // si riabilitano e il prossimo fronte riarma il timer dall'ISR.
+            //
+            lanes_intr(armed, true);
+        }
+    }
+}
+
+static esp_err_t
+edge_start (vdebounce_t * p_deb)
+{
+    esp_err_t ret = ESP_OK;
+    TickType_t ticks = pdMS_TO_TICKS(p_deb->cfg.period_us / 1000);
+
+    p_deb->h_confirm = xTimerCreate("vdebounce", (ticks > 0) ? ticks : 1, pdFALSE, p_deb, confirm);
+
+    if (NULL == p_deb->h_confirm)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ret = gpio_install_isr_service(0);
+
+    if ((ret != ESP_OK) && (ret != ESP_ERR_INVALID_STATE))
+    {
+        return ret;
+    }
+
+    // Tutte le linee partono armate: la prima conferma fissa lo stato
+    // iniziale, poi la CPU resta libera fino al prossimo fronte.
+    //
+    p_deb->armed = p_deb->cfg.mask;
+
+    for (uint32_t gpio = 0; gpio < 32; ++gpio)
+    {
+        if (p_deb->cfg.mask & BIT(gpio))
+        {
+            p_deb->lanes[gpio].p_deb = p_deb;
+            p_deb->lanes[gpio].gpio = gpio;
+
+            ret = gpio_set_intr_type(gpio, GPIO_INTR_ANYEDGE);
+
+            if (ESP_OK == ret)
+            {
+                ret = gpio_isr_handler_add(gpio, isr_edge, &p_deb->lanes[gpio]);
+            }
+
+            if (ESP_OK == ret)
+            {
+                ret = gpio_intr_disable(gpio);
+            }
+
+            if (ret != ESP_OK)
+            {
+                return ret;
+            }
+        }
+    }
+
+    return (pdPASS == xTimerStart(p_deb->h_confirm, portMAX_DELAY)) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t
+vdebounce_start (vdebounce_t * p_deb, const vdebounce_config_t * p_cfg)
+{
+    esp_err_t ret = ESP_OK;
+    gpio_config_t io_cfg = {0};
+    esp_timer_create_args_t timer_args = {
+        .callback = sample,
+        .arg = p_deb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "vdebounce",
+    };
+
+    if ((NULL == p_cfg->h_queue) || (0 == p_cfg->mask))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(p_deb, 0, sizeof(*p_deb));
+    p_deb->cfg = *p_cfg;
+    p_deb->mux = (portMUX_TYPE) portMUX_INITIALIZER_UNLOCKED;
+
+    if (0 == p_deb->cfg.period_us)
+    {
+        p_deb->cfg.period_us = (VDEBOUNCE_MODE_EDGE == p_cfg->mode) ? VDEBOUNCE_CONFIRM_US : VDEBOUNCE_PERIOD_US;
+    }
+
+    // Le linee partono a riposo: i contatori a 11 corrispondono a "nessun
+    // campione diverso ancora visto".
+    //
+    p_deb->cnt0 = 0xFFFFFFFF;
+    p_deb->cnt1 = 0xFFFFFFFF;
+
+    io_cfg.mode = GPIO_MODE_INPUT;
+    io_cfg.intr_type = GPIO_INTR_DISABLE;
+
+    if (p_cfg->mask & p_cfg->active_low)
+    {
+        io_cfg.pin_bit_mask = p_cfg->mask & p_cfg->active_low;
+        io_cfg.pull_up_en = GPIO_PULLUP_ENABLE;
+        io_cfg.pull_down_en = GPIO_PULLDOWN_DISABLE;
+        ret = gpio_config(&io_cfg);
+
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+
+    if (p_cfg->mask & ~p_cfg->active_low)
+    {
+        io_cfg.pin_bit_mask = p_cfg->mask & ~p_cfg->active_low;
+        io_cfg.pull_up_en = GPIO_PULLUP_DISABLE;
+        io_cfg.pull_down_en = GPIO_PULLDOWN_ENABLE;
+        ret = gpio_config(&io_cfg);
+
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+
+    if (VDEBOUNCE_MODE_EDGE == p_cfg->mode)
+    {
+        return edge_start(p_deb);
+    }
+
+    ret = esp_timer_create(&timer_args, &p_deb->h_timer);
+
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    return esp_timer_start_periodic(p_deb->h_timer, p_deb->cfg.period_us);
+}
+
+esp_err_t
+vdebounce_stop (vdebounce_t * p_deb)
+{
+    esp_err_t ret = ESP_OK;
+
+    if (VDEBOUNCE_MODE_EDGE == p_deb->cfg.mode)
+    {
+        // Prima si staccano gli handler e si spengono gli interrupt delle
+        // linee: nessuna ISR puo' piu' riarmare il timer che viene cancellato.
+        //
+        for (uint32_t gpio = 0; gpio < 32; ++gpio)
+        {
+            if (p_deb->cfg.mask & BIT(gpio))
+            {
+                (void) gpio_isr_handler_remove(gpio);
+                (void) gpio_set_intr_type(gpio, GPIO_INTR_DISABLE);
+            }
+        }
+
+        if (xTimerDelete(p_deb->h_confirm, portMAX_DELAY) != pdPASS)
+        {
+            return ESP_FAIL;
+        }
+
+        p_deb->h_confirm = NULL;
+
+        return ESP_OK;
+    }
+
+    ret = esp_timer_stop(p_deb->h_timer);
+
+    // Un timer gia' fermo si cancella comunque
+    //
+    if ((ESP_OK == ret) || (ESP_ERR_INVALID_STATE == ret))
+    {
+        ret = esp_timer_delete(p_deb->h_timer);
+    }
+
+    if (ESP_OK == ret)
+    {
+        p_deb->h_timer = NULL;
+    }
+
+    return ret;
+}
+
+uint32_t
+vdebounce_state (const vdebounce_t * p_deb)
+{
+    return p_deb->state;
+}
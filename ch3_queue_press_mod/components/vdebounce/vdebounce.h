@@ -0,0 +1,75 @@
+#ifndef VDEBOUNCE_H
+#define VDEBOUNCE_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/timers.h>
+#include <esp_timer.h>
+#include <esp_err.h>
+#include <stdint.h>
+
+// Periodo di campionamento: il fronte e' riconosciuto dopo 4 campioni stabili
+#define VDEBOUNCE_PERIOD_US     2000
+// Modo a fronti: livello confermato da due letture consecutive del timer
+#define VDEBOUNCE_CONFIRM_US    10000
+
+typedef enum
+{
+    VDEBOUNCE_MODE_POLL = 0,    // Campionamento periodico continuo
+    VDEBOUNCE_MODE_EDGE         // ISR sul fronte + timer one-shot di conferma
+} vdebounce_mode_t;
+
+typedef struct
+{
+    uint32_t changed;       // Linee che hanno cambiato stato
+    uint32_t state;         // Stato filtrato di tutte le linee (1 = attivo)
+} vdebounce_event_t;
+
+typedef struct
+{
+    uint32_t mask;          // GPIO 0..31 gestiti
+    uint32_t active_low;    // Linee attive basse (pull-up abilitato)
+    uint32_t period_us;
+    vdebounce_mode_t mode;
+    QueueHandle_t h_queue;  // Coda di vdebounce_event_t
+} vdebounce_config_t;
+
+typedef struct vdebounce_s vdebounce_t;
+
+typedef struct
+{
+    vdebounce_t * p_deb;
+    uint32_t gpio;
+} vdebounce_lane_t;
+
+struct vdebounce_s
+{
+    vdebounce_config_t cfg;
+    esp_timer_handle_t h_timer;
+    TimerHandle_t h_confirm;
+    portMUX_TYPE mux;
+    uint32_t armed;         // Linee con interrupt disabilitato in attesa di conferma
+    uint32_t seen;          // Linee gia' campionate almeno una volta dal timer
+    uint32_t prev;          // Campione precedente del timer di conferma
+    vdebounce_lane_t lanes[32];
+    uint32_t state;
+    uint32_t cnt0;          // Contatore verticale a 2 bit, bit 0
+    uint32_t cnt1;          // Contatore verticale a 2 bit, bit 1
+    uint32_t pending;       // Fronti non ancora accodati (coda piena)
+    uint32_t n_overflow;
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+esp_err_t vdebounce_start(vdebounce_t * p_deb, const vdebounce_config_t * p_cfg);
+esp_err_t vdebounce_stop(vdebounce_t * p_deb);
+uint32_t vdebounce_state(const vdebounce_t * p_deb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VDEBOUNCE_H */
@@ -1,68 +1,174 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
 #include <freertos/task.h>
+#include <esp_timer.h>
+#include <rom/ets_sys.h>
 #include <stdint.h>
+#include <stdio.h>
 #include "driver/gpio.h"
+#include "../components/vdebounce/vdebounce.h"
 
 #define GPIO_LED        15
 #define GPIO_BUTTONL    21
 #define GPIO_BUTTONR    19
 
+// 1: interrupt sul fronte e conferma via timer, 0: campionamento periodico
+#define DEBOUNCE_EDGE   1
+
+// 1: GPIO_BUTTONL e' pilotato da tracce di rimbalzi scritte su GPIO_SIM_BOUNCE,
+// da collegare con un filo a GPIO_BUTTONL: i fronti passano dal pin e dall'ISR
+// reali; fronti persi, fronti falsi e tempo di conferma sono riassunti a ogni
+// giro dello script
+#define SIM_BOUNCE      0
+#define GPIO_SIM_BOUNCE 18
+#define SIM_GAP_MS      100     // Pausa dopo ogni traccia, oltre la conferma
+
 static QueueHandle_t queue = NULL;
-static const int reset_press = -998;
+static vdebounce_t g_debounce = {0};
+
+#if SIM_BOUNCE
+typedef struct
+{
+    uint32_t n_edges;       // Commutazioni del pin: pari = disturbo, nessun evento
+    uint32_t gap_us[8];     // Intervallo fra una commutazione e la successiva
+} sim_trace_t;
+
+static const sim_trace_t g_script[] = {
+    {1, {0}},                                       // Pressione pulita
+    {1, {0}},                                       // Rilascio pulito
+    {5, {100, 300, 200, 800}},                      // Pressione, rimbalzi ~1.4 ms
+    {7, {50, 150, 400, 200, 1200, 2500}},           // Rilascio, rimbalzi ~4.5 ms
+    {2, {200}},                                     // Impulso isolato
+    {9, {80, 80, 120, 300, 600, 900, 1500, 3000}},  // Pressione rumorosa ~6.6 ms
+    {2, {4000}},                                    // Impulso lungo, sotto la conferma
+    {3, {30, 30}}                                   // Rilascio con un rimbalzo breve
+};
+
+#define SIM_TRACES  (sizeof(g_script) / sizeof(g_script[0]))
+
+static portMUX_TYPE g_sim_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t g_sim_events = 0;       // Eventi della linea nella traccia corrente
+static uint32_t g_sim_state = 0;        // Stato riportato dall'ultimo evento
+static int64_t g_sim_event_us = 0;      // Ricezione del primo evento
 
 static void
-task_debounce (void * argp)
+sim_event (const vdebounce_event_t * p_event)
 {
-    uint32_t button_gpio = *((gpio_num_t *) argp);
-    uint32_t level = 0;
+    int64_t now = esp_timer_get_time();
+
+    if (0 == (p_event->changed & BIT(GPIO_BUTTONL)))
+    {
+        return;
+    }
+
+    portENTER_CRITICAL(&g_sim_mux);
+
+    if (0 == g_sim_events++)
+    {
+        g_sim_event_us = now;
+    }
+
+    g_sim_state = (p_event->state >> GPIO_BUTTONL) & 1;
+    portEXIT_CRITICAL(&g_sim_mux);
+}
+
+// Ogni traccia deve produrre un solo evento con lo stato finale del pin se il
+// livello cambia, nessuno se torna al livello di partenza. Il tempo di
+// conferma va dall'ultima commutazione alla ricezione dell'evento nel task.
+//
+static void
+task_sim (void * argp)
+{
+    uint32_t level = 1;     // A riposo: linea attiva bassa, pulsante rilasciato
+    uint32_t start = 0;
+    uint32_t n_traces = 0;
+    uint32_t n_missed = 0;
+    uint32_t n_false = 0;
+    uint32_t n_confirmed = 0;
+    uint64_t confirm_sum = 0;
+    int64_t confirm_max = 0;
+    int64_t confirm = 0;
+    int64_t settle_us = 0;
+    uint32_t events = 0;
     uint32_t state = 0;
-    uint32_t mask = 0x7FFFFFFF;
-    int32_t event;
-    int32_t last = -999;
+    int64_t event_us = 0;
+
+    // Lascia fissare lo stato iniziale prima della prima traccia
+    //
+    vTaskDelay(pdMS_TO_TICKS(SIM_GAP_MS));
 
     for (;;)
     {
-        level = !gpio_get_level(button_gpio);
-        state = (state << 1) | level;
+        const sim_trace_t * p_trace = &g_script[n_traces % SIM_TRACES];
 
-        if ((state & mask) == mask)
-        {
-            event = button_gpio;
-        }
-        else
+        portENTER_CRITICAL(&g_sim_mux);
+        g_sim_events = 0;
+        portEXIT_CRITICAL(&g_sim_mux);
+
+        // I rimbalzi durano pochi ms: attesa attiva per avere intervalli
+        // precisi al microsecondo, poi il task dorme fino al controllo.
+        //
+        start = level;
+
+        for (uint32_t idx = 0; idx < p_trace->n_edges; ++idx)
         {
-            event = -button_gpio;
+            if (idx > 0)
+            {
+                ets_delay_us(p_trace->gap_us[idx - 1]);
+            }
+
+            level ^= 1;
+            (void) gpio_set_level(GPIO_SIM_BOUNCE, level);
         }
 
-        if (event != last)
+        settle_us = esp_timer_get_time();
+        vTaskDelay(pdMS_TO_TICKS(SIM_GAP_MS));
+
+        portENTER_CRITICAL(&g_sim_mux);
+        events = g_sim_events;
+        state = g_sim_state;
+        event_us = g_sim_event_us;
+        portEXIT_CRITICAL(&g_sim_mux);
+
+        if (level != start)
         {
-            if (pdPASS == xQueueSendToBack(queue, &event, 0))
+            // Stato logico atteso: linea attiva bassa
+            //
+            if ((0 == events) || (state != !level))
             {
-                last = event;
+                n_missed++;
             }
-            else if (event < 0)
+            else
             {
-                do
-                {
-                    xQueueReset(queue);
-                } while (xQueueSendToBack(queue, &reset_press, 0) != pdPASS);
-
-                last = event;
+                confirm = (event_us > settle_us) ? event_us - settle_us : 0;
+                confirm_sum += confirm;
+                confirm_max = (confirm > confirm_max) ? confirm : confirm_max;
+                n_confirmed++;
             }
+
+            n_false += (events > 1) ? events - 1 : 0;
+        }
+        else
+        {
+            n_false += events;
         }
 
-        taskYIELD();
+        if (0 == (++n_traces % SIM_TRACES))
+        {
+            printf("sim: %u traces, %u missed, %u false, confirm avg %llu max %lld us\n",
+                   n_traces, n_missed, n_false, (n_confirmed > 0) ? confirm_sum / n_confirmed : 0,
+                   (long long) confirm_max);
+        }
     }
 }
+#endif /* SIM_BOUNCE */
 
 static void
 task_led (void * argp)
 {
     static const uint32_t enable = (1 << GPIO_BUTTONL) | (1 << GPIO_BUTTONR);
     BaseType_t st;
-    int32_t event;
-    uint32_t state = 0;
+    vdebounce_event_t event;
 
     (void) gpio_set_level(GPIO_LED, 0);
 
@@ -71,31 +177,20 @@ task_led (void * argp)
         st = xQueueReceive(queue, &event, portMAX_DELAY);
         assert(pdPASS == st);
 
-        if (reset_press == event)
+#if SIM_BOUNCE
+        sim_event(&event);
+#endif /* SIM_BOUNCE */
+
+        // L'evento contiene lo stato di tutti i pulsanti: anche dopo un
+        // overflow della coda lo stato ricevuto e' sempre coerente.
+        //
+        if ((event.state & enable) == enable)
         {
-            (void) gpio_set_level(GPIO_LED, 0);
-            state = 0;
-            printf("RESET!\n");
+            (void) gpio_set_level(GPIO_LED, 1);
         }
         else
         {
-            if (event >= 0)
-            {
-                state |= 1 << event;
-            }
-            else
-            {
-                state &= ~(1 << -event);
-            }
-
-            if (state == enable)
-            {
-                (void) gpio_set_level(GPIO_LED, 1);
-            }
-            else
-            {
-                (void) gpio_set_level(GPIO_LED, 0);
-            }
+            (void) gpio_set_level(GPIO_LED, 0);
         }
     }
 }
@@ -104,36 +199,51 @@ void
 app_main (void)
 {
     int app_cpu = xPortGetCoreID();
-    static int left = GPIO_BUTTONL;
-    static int right = GPIO_BUTTONR;
+    vdebounce_config_t cfg = {0};
     TaskHandle_t h_task = NULL;
     BaseType_t rc = 0;
 
     vTaskDelay(pdMS_TO_TICKS(2000));
 
-    queue = xQueueCreate(40, sizeof(int32_t));
+    queue = xQueueCreate(40, sizeof(vdebounce_event_t));
     assert(queue);
     
     gpio_pad_select_gpio(GPIO_LED);
     (void) gpio_set_direction(GPIO_LED, GPIO_MODE_OUTPUT);
 
     gpio_pad_select_gpio(GPIO_BUTTONL);
-    (void) gpio_set_direction(GPIO_BUTTONL, GPIO_MODE_INPUT);
-    (void) gpio_set_pull_mode(GPIO_BUTTONL, GPIO_PULLUP_ONLY);
-
     gpio_pad_select_gpio(GPIO_BUTTONR);
-    (void) gpio_set_direction(GPIO_BUTTONR, GPIO_MODE_INPUT);
-    (void) gpio_set_pull_mode(GPIO_BUTTONR, GPIO_PULLUP_ONLY);
 
-    rc = xTaskCreatePinnedToCore(task_debounce, "debounce_l", 2048, &left, 1, &h_task, app_cpu);
-    assert(pdPASS == rc);
-    assert(h_task);
+#if SIM_BOUNCE
+    // L'uscita simulata parte a riposo prima che il debouncer legga la linea
+    //
+    gpio_pad_select_gpio(GPIO_SIM_BOUNCE);
+    ESP_ERROR_CHECK(gpio_set_direction(GPIO_SIM_BOUNCE, GPIO_MODE_OUTPUT));
+    ESP_ERROR_CHECK(gpio_set_level(GPIO_SIM_BOUNCE, 1));
+#endif /* SIM_BOUNCE */
 
-    rc = xTaskCreatePinnedToCore(task_debounce, "debounce_r", 2048, &right, 1, &h_task, app_cpu);
+    rc = xTaskCreatePinnedToCore(task_led, "led", 2048, NULL, 1, &h_task, app_cpu);
     assert(pdPASS == rc);
     assert(h_task);
 
-    rc = xTaskCreatePinnedToCore(task_led, "led", 2048, NULL, 1, &h_task, app_cpu);
+    // Un solo timer campiona tutti i pulsanti, il costo non dipende dal
+    // numero di linee. Nel modo a fronti il timer parte solo dopo un
+    // interrupt e a pulsanti fermi la CPU non esegue nulla.
+    //
+    cfg.mask = (1 << GPIO_BUTTONL) | (1 << GPIO_BUTTONR);
+    cfg.active_low = cfg.mask;
+#if DEBOUNCE_EDGE
+    cfg.mode = VDEBOUNCE_MODE_EDGE;
+    cfg.period_us = VDEBOUNCE_CONFIRM_US;
+#else
+    cfg.mode = VDEBOUNCE_MODE_POLL;
+    cfg.period_us = VDEBOUNCE_PERIOD_US;
+#endif /* DEBOUNCE_EDGE */
+    cfg.h_queue = queue;
+    ESP_ERROR_CHECK(vdebounce_start(&g_debounce, &cfg));
+
+#if SIM_BOUNCE
+    rc = xTaskCreatePinnedToCore(task_sim, "sim", 2048, NULL, 3, NULL, app_cpu);
     assert(pdPASS == rc);
-    assert(h_task);
-}
\ No newline at end of file
+#endif /* SIM_BOUNCE */
+}
@@ -0,0 +1,121 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_attr.h>
+#include <esp_err.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "blog.h"
+
+static blog_ring_t g_rings[portNUM_PROCESSORS] = {0};
+static uint32_t g_seq = 0;
+
+// Un ring per core: basta mascherare gli interrupt del core corrente per
+// escludere gli altri produttori, nessuno spinlock fra i core.
+//
+void IRAM_ATTR
+blog_write (const char * p_fmt, uint32_t n_args, ...)
+{
+    uint32_t state = portSET_INTERRUPT_MASK_FROM_ISR();
+    blog_ring_t * p_ring = &g_rings[xPortGetCoreID()];
+    uint32_t head = p_ring->head;
+    blog_record_t * p_rec = NULL;
+    va_list ap;
+
+    if ((head - __atomic_load_n(&p_ring->tail, __ATOMIC_ACQUIRE)) >= BLOG_RING_SIZE)
+    {
+        p_ring->n_drop++;
+        portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+        return;
+    }
+
+    p_rec = &p_ring->records[head & (BLOG_RING_SIZE - 1)];
+    p_rec->p_fmt = p_fmt;
+    p_rec->seq = __atomic_fetch_add(&g_seq, 1, __ATOMIC_RELAXED);
+
+    va_start(ap, n_args);
+
+    for (uint32_t idx = 0; (idx < n_args) && (idx < BLOG_MAX_ARGS); ++idx)
+    {
+        p_rec->args[idx] = va_arg(ap, uint32_t);
+    }
+
+    va_end(ap);
+
+    __atomic_store_n(&p_ring->head, head + 1, __ATOMIC_RELEASE);
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+}
+
+uint32_t
+blog_dropped (void)
+{
+    uint32_t total = 0;
+
+    for (uint32_t core = 0; core < portNUM_PROCESSORS; ++core)
+    {
+        total += g_rings[core].n_drop;
+    }
+
+    return total;
+}
+
+static void
+task_drain (void * p_arg)
+{
+    blog_record_t * p_rec = NULL;
+    blog_ring_t * p_next = NULL;
+    uint32_t drops = 0;
+
+    for (;;)
+    {
+        // Fra i record in testa ai ring si formatta sempre quello con la
+        // sequenza minore: l'uscita segue l'ordine delle chiamate
+        //
+        for (;;)
+        {
+            p_next = NULL;
+
+            for (uint32_t core = 0; core < portNUM_PROCESSORS; ++core)
+            {
+                blog_ring_t * p_ring = &g_rings[core];
+
+                if (__atomic_load_n(&p_ring->head, __ATOMIC_ACQUIRE) == p_ring->tail)
+                {
+                    continue;
+                }
+
+                if ((NULL == p_next) || ((int32_t) (p_ring->records[p_ring->tail & (BLOG_RING_SIZE - 1)].seq
+                                                    - p_next->records[p_next->tail & (BLOG_RING_SIZE - 1)].seq) < 0))
+                {
+                    p_next = p_ring;
+                }
+            }
+
+            if (NULL == p_next)
+            {
+                break;
+            }
+
+            p_rec = &p_next->records[p_next->tail & (BLOG_RING_SIZE - 1)];
+            fprintf(stderr, "%05u: ", p_rec->seq);
+            fprintf(stderr, p_rec->p_fmt, p_rec->args[0], p_rec->args[1], p_rec->args[2], p_rec->args[3]);
+            __atomic_store_n(&p_next->tail, p_next->tail + 1, __ATOMIC_RELEASE);
+        }
+
+        if (blog_dropped() != drops)
+        {
+            drops = blog_dropped();
+            fprintf(stderr, "blog: %u records dropped\n", drops);
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(BLOG_DRAIN_MS));
+    }
+}
+
+esp_err_t
+blog_init (UBaseType_t prio, BaseType_t core)
+{
+    BaseType_t ret = xTaskCreatePinnedToCore(task_drain, "blog", 3072, NULL, prio, NULL, core);
+
+    return (pdPASS == ret) ? ESP_OK : ESP_ERR_NO_MEM;
+}
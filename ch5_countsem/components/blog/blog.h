@@ -0,0 +1,63 @@
+#ifndef BLOG_H
+#define BLOG_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_err.h>
+#include <stdint.h>
+
+#define BLOG_RING_SIZE  64      // Record per core, potenza di 2
+#define BLOG_MAX_ARGS   4
+#define BLOG_DRAIN_MS   20
+
+typedef struct
+{
+    const char * p_fmt;     // Deve restare valido: tipicamente una costante
+    uint32_t seq;           // Ordine globale fra i due core
+    uint32_t args[BLOG_MAX_ARGS];
+} blog_record_t;
+
+typedef struct
+{
+    blog_record_t records[BLOG_RING_SIZE];
+    uint32_t head;          // Scritto solo dal core proprietario
+    uint32_t tail;          // Scritto solo dal task di scarico
+    uint32_t n_drop;
+} blog_ring_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+esp_err_t blog_init(UBaseType_t prio, BaseType_t core);
+void blog_write(const char * p_fmt, uint32_t n_args, ...);
+uint32_t blog_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+// BLOG("fmt", a, b) registra il puntatore al formato e fino a BLOG_MAX_ARGS
+// argomenti; printf avviene dopo, nel task di scarico. Limiti:
+// - ogni argomento e' letto con va_arg(ap, uint32_t): int64_t, uint64_t e
+//   double corrompono il record, niente %lld ne' %f;
+// - un %s e' dereferenziato solo nel task di scarico: la stringa deve restare
+//   valida fino ad allora (costante o statica, niente buffer sullo stack).
+// Piu' di BLOG_MAX_ARGS argomenti non compilano (il conteggio arriva a 8) e
+// il formato e' controllato come quello di printf.
+//
+int blog_format_check(const char * p_fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#define BLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...)    n
+#define BLOG_NARGS(...)     BLOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define BLOG(fmt, ...)                                                              \
+    do                                                                              \
+    {                                                                               \
+        _Static_assert(BLOG_NARGS(__VA_ARGS__) <= BLOG_MAX_ARGS, "BLOG: troppi argomenti"); \
+        (void) sizeof(blog_format_check((fmt), ##__VA_ARGS__));                     \
+        blog_write((fmt), BLOG_NARGS(__VA_ARGS__), ##__VA_ARGS__);                  \
+    }                                                                               \
+    while (0)
+
+#endif /* BLOG_H */
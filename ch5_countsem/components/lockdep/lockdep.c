@@ -0,0 +1,408 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_bit_defs.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "lockdep.h"
+
+#if LOCKDEP_EN
+
+typedef struct
+{
+    uint32_t id;
+    int64_t usecs;          // Istante della presa
+} held_t;
+
+// Slot occupato solo finche' il task tiene almeno un lock
+//
+typedef struct
+{
+    TaskHandle_t h_task;
+    uint32_t n_held;
+    held_t held[LOCKDEP_MAX_HELD];
+} task_slot_t;
+
+static portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+static lockdep_lock_t * g_locks[LOCKDEP_MAX_LOCKS] = {0};
+static uint32_t g_n_locks = 0;
+static task_slot_t g_tasks[LOCKDEP_MAX_TASKS] = {0};
+
+// Grafo d'ordine: bit b di g_after[a] = b e' stato preso tenendo a
+//
+static uint32_t g_after[LOCKDEP_MAX_LOCKS] = {0};
+static uint32_t g_n_cycles = 0;
+static uint32_t g_n_untracked = 0;
+
+esp_err_t
+lockdep_init (lockdep_lock_t * p_lock, SemaphoreHandle_t h_sem, const char * p_name)
+{
+    esp_err_t err = ESP_OK;
+
+    memset(p_lock, 0, sizeof(*p_lock));
+    p_lock->h_sem = h_sem;
+    p_lock->p_name = p_name;
+
+    taskENTER_CRITICAL(&g_mux);
+
+    if (g_n_locks < LOCKDEP_MAX_LOCKS)
+    {
+        p_lock->id = g_n_locks;
+        g_locks[g_n_locks++] = p_lock;
+    }
+    else
+    {
+        err = ESP_ERR_NO_MEM;
+    }
+
+    taskEXIT_CRITICAL(&g_mux);
+
+    return err;
+}
+
+static task_slot_t *
+find_task (TaskHandle_t h_task)
+{
+    for (uint32_t idx = 0; idx < LOCKDEP_MAX_TASKS; ++idx)
+    {
+        if (g_tasks[idx].h_task == h_task)
+        {
+            return &g_tasks[idx];
+        }
+    }
+
+    return NULL;
+}
+
+// Visita in ampiezza sulle maschere: riempie p_path con from -> ... -> to e
+// ne ritorna la lunghezza, 0 se to non e' raggiungibile
+//
+static uint32_t
+find_path (uint32_t from, uint32_t to, uint32_t * p_path)
+{
+    uint32_t parent[LOCKDEP_MAX_LOCKS] = {0};
+    uint32_t visited = BIT(from);
+    uint32_t frontier = BIT(from);
+    uint32_t next = 0;
+    uint32_t fresh = 0;
+    uint32_t len = 0;
+
+    while (frontier != 0)
+    {
+        next = 0;
+
+        for (uint32_t a = 0; a < g_n_locks; ++a)
+        {
+            if (0 == (frontier & BIT(a)))
+            {
+                continue;
+            }
+
+            fresh = g_after[a] & ~visited;
+            visited |= fresh;
+            next |= fresh;
+
+            for (; fresh != 0; fresh &= fresh - 1)
+            {
+                parent[__builtin_ctz(fresh)] = a;
+            }
+        }
+
+        if (visited & BIT(to))
+        {
+            for (uint32_t node = to; node != from; node = parent[node])
+            {
+                ++len;
+            }
+
+            p_path[len] = to;
+
+            for (uint32_t pos = len, node = to; node != from; --pos)
+            {
+                node = parent[node];
+                p_path[pos - 1] = node;
+            }
+
+            return len + 1;
+        }
+
+        frontier = next;
+    }
+
+    return 0;
+}
+
+// Registra gli archi "tenuto -> richiesto" prima di bloccarsi: un ciclo viene
+// segnalato quando l'ordine si inverte la prima volta, non quando si blocca.
+// Tutti gli archi nuovi entrano nel grafo prima della ricerca, anche se il
+// ciclo riportato e' uno solo.
+//
+static uint32_t
+check_order (TaskHandle_t h_self, uint32_t id, uint32_t * p_cycle)
+{
+    task_slot_t * p_slot = NULL;
+    uint32_t fresh = 0;
+    uint32_t len = 0;
+    uint32_t held = 0;
+
+    taskENTER_CRITICAL(&g_mux);
+    p_slot = find_task(h_self);
+
+    for (uint32_t idx = 0; (p_slot != NULL) && (idx < p_slot->n_held); ++idx)
+    {
+        held = p_slot->held[idx].id;
+
+        if (held == id)
+        {
+            p_cycle[0] = id;
+            len = 1;
+        }
+        else if (0 == (g_after[held] & BIT(id)))
+        {
+            g_after[held] |= BIT(id);
+            fresh |= BIT(held);
+        }
+    }
+
+    for (; (0 == len) && (fresh != 0); fresh &= fresh - 1)
+    {
+        held = __builtin_ctz(fresh);
+        p_cycle[0] = held;
+        len = find_path(id, held, &p_cycle[1]);
+        len = (len != 0) ? (len + 1) : 0;
+    }
+
+    if (len != 0)
+    {
+        g_n_cycles++;
+    }
+
+    taskEXIT_CRITICAL(&g_mux);
+
+    return len;
+}
+
+static void
+print_cycle (TaskHandle_t h_self, const uint32_t * p_cycle, uint32_t len)
+{
+    if (1 == len)
+    {
+        fprintf(stderr, "lockdep: %s taken twice by %s\n", g_locks[p_cycle[0]]->p_name, pcTaskGetName(h_self));
+        return;
+    }
+
+    fprintf(stderr, "lockdep: order cycle closed by %s:", pcTaskGetName(h_self));
+
+    for (uint32_t idx = 0; idx < len; ++idx)
+    {
+        fprintf(stderr, "%s%s", (0 == idx) ? " " : " -> ", g_locks[p_cycle[idx]]->p_name);
+    }
+
+    fprintf(stderr, "\n");
+}
+
+BaseType_t
+lockdep_take (lockdep_lock_t * p_lock, TickType_t ticks)
+{
+    TaskHandle_t h_self = xTaskGetCurrentTaskHandle();
+    uint32_t cycle[LOCKDEP_MAX_LOCKS + 1] = {0};
+    uint32_t len = 0;
+    task_slot_t * p_slot = NULL;
+    int64_t start = 0;
+    int64_t now = 0;
+    int64_t wait = 0;
+    BaseType_t ret = 0;
+
+    len = check_order(h_self, p_lock->id, cycle);
+
+    if (len != 0)
+    {
+        print_cycle(h_self, cycle, len);
+    }
+
+    // Il tentativo senza attesa separa le prese libere da quelle contese e
+    // tiene il percorso veloce a una sola chiamata al kernel
+    //
+    ret = xSemaphoreTake(p_lock->h_sem, 0);
+
+    if ((ret != pdPASS) && (ticks != 0))
+    {
+        start = esp_timer_get_time();
+        ret = xSemaphoreTake(p_lock->h_sem, ticks);
+        now = esp_timer_get_time();
+        wait = now - start;
+    }
+    else
+    {
+        now = esp_timer_get_time();
+    }
+
+    taskENTER_CRITICAL(&g_mux);
+
+    if (start != 0)
+    {
+        p_lock->n_contended++;
+        p_lock->wait_us += wait;
+
+        if (wait > p_lock->wait_max_us)
+        {
+            p_lock->wait_max_us = wait;
+        }
+    }
+
+    if (ret != pdPASS)
+    {
+        p_lock->n_timeout++;
+    }
+    else
+    {
+        p_lock->n_take++;
+        p_lock->h_owner = h_self;
+
+        p_slot = find_task(h_self);
+
+        if (NULL == p_slot)
+        {
+            p_slot = find_task(NULL);
+        }
+
+        if ((p_slot != NULL) && (p_slot->n_held < LOCKDEP_MAX_HELD))
+        {
+            p_slot->h_task = h_self;
+            p_slot->held[p_slot->n_held].id = p_lock->id;
+            p_slot->held[p_slot->n_held].usecs = now;
+            p_slot->n_held++;
+        }
+        else
+        {
+            g_n_untracked++;
+        }
+    }
+
+    taskEXIT_CRITICAL(&g_mux);
+
+    return ret;
+}
+
+BaseType_t
+lockdep_give (lockdep_lock_t * p_lock)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t hold = 0;
+    task_slot_t * p_slot = NULL;
+
+    taskENTER_CRITICAL(&g_mux);
+    p_slot = find_task(xTaskGetCurrentTaskHandle());
+
+    for (uint32_t idx = 0; (p_slot != NULL) && (idx < p_slot->n_held); ++idx)
+    {
+        if (p_slot->held[idx].id != p_lock->id)
+        {
+            continue;
+        }
+
+        hold = now - p_slot->held[idx].usecs;
+        p_lock->hold_us += hold;
+
+        if (hold > p_lock->hold_max_us)
+        {
+            p_lock->hold_max_us = hold;
+        }
+
+        // I rilasci possono avvenire in qualunque ordine
+        //
+        p_slot->n_held--;
+        memmove(&p_slot->held[idx], &p_slot->held[idx + 1], (p_slot->n_held - idx) * sizeof(held_t));
+
+        if (0 == p_slot->n_held)
+        {
+            p_slot->h_task = NULL;
+        }
+
+        break;
+    }
+
+    taskEXIT_CRITICAL(&g_mux);
+
+    return xSemaphoreGive(p_lock->h_sem);
+}
+
+uint32_t
+lockdep_cycles (void)
+{
+    return g_n_cycles;
+}
+
+void
+lockdep_dump (void)
+{
+    uint32_t order[LOCKDEP_MAX_LOCKS] = {0};
+    int64_t wait[LOCKDEP_MAX_LOCKS] = {0};
+    uint32_t n_locks = g_n_locks;
+    lockdep_lock_t snap = {0};
+    uint32_t tmp = 0;
+
+    taskENTER_CRITICAL(&g_mux);
+
+    for (uint32_t idx = 0; idx < n_locks; ++idx)
+    {
+        order[idx] = idx;
+        wait[idx] = g_locks[idx]->wait_us;
+    }
+
+    taskEXIT_CRITICAL(&g_mux);
+
+    // Punti caldi prima: ordinati per attesa totale decrescente
+    //
+    for (uint32_t idx = 1; idx < n_locks; ++idx)
+    {
+        for (uint32_t pos = idx; (pos > 0) && (wait[order[pos]] > wait[order[pos - 1]]); --pos)
+        {
+            tmp = order[pos];
+            order[pos] = order[pos - 1];
+            order[pos - 1] = tmp;
+        }
+    }
+
+    fprintf(stderr, "lock          takes   cont    tmo  wait avg/max us  hold avg/max us  owner\n");
+
+    for (uint32_t idx = 0; idx < n_locks; ++idx)
+    {
+        taskENTER_CRITICAL(&g_mux);
+        snap = *g_locks[order[idx]];
+        taskEXIT_CRITICAL(&g_mux);
+
+        fprintf(stderr, "%-12s %6u %6u %6u %7lld/%-7lld %7lld/%-7lld  %s\n",
+                snap.p_name, snap.n_take, snap.n_contended, snap.n_timeout,
+                (snap.n_contended != 0) ? (snap.wait_us / snap.n_contended) : 0, snap.wait_max_us,
+                (snap.n_take != 0) ? (snap.hold_us / snap.n_take) : 0, snap.hold_max_us,
+                (snap.h_owner != NULL) ? pcTaskGetName(snap.h_owner) : "-");
+    }
+
+    for (uint32_t a = 0; a < n_locks; ++a)
+    {
+        if (0 == g_after[a])
+        {
+            continue;
+        }
+
+        fprintf(stderr, "order: %s ->", g_locks[a]->p_name);
+
+        for (uint32_t b = 0; b < n_locks; ++b)
+        {
+            if (g_after[a] & BIT(b))
+            {
+                fprintf(stderr, " %s", g_locks[b]->p_name);
+            }
+        }
+
+        fprintf(stderr, "\n");
+    }
+
+    fprintf(stderr, "lockdep: %u cycles, %u untracked takes\n", g_n_cycles, g_n_untracked);
+}
+
+#endif /* LOCKDEP_EN */
@@ -0,0 +1,90 @@
+#ifndef LOCKDEP_H
+#define LOCKDEP_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_err.h>
+#include <stdint.h>
+
+// 0: lockdep_take()/lockdep_give() diventano xSemaphoreTake()/Give() senza
+// alcuna registrazione. Va definito per tutto il progetto, ad esempio con
+// idf_build_set_property(COMPILE_DEFINITIONS "-DLOCKDEP_EN=0" APPEND)
+//
+#ifndef LOCKDEP_EN
+#   define LOCKDEP_EN       1
+#endif /* LOCKDEP_EN */
+
+#define LOCKDEP_MAX_LOCKS   32      // Un bit per lock nel grafo d'ordine
+#define LOCKDEP_MAX_TASKS   16
+#define LOCKDEP_MAX_HELD    4       // Lock tenuti insieme da un task
+
+typedef struct
+{
+    SemaphoreHandle_t h_sem;
+    const char * p_name;
+    uint32_t id;
+    TaskHandle_t h_owner;   // Ultimo task che l'ha preso
+    uint32_t n_take;
+    uint32_t n_contended;   // Prese che hanno dovuto attendere
+    uint32_t n_timeout;
+    int64_t wait_us;        // Totale attese
+    int64_t wait_max_us;
+    int64_t hold_us;        // Totale possesso
+    int64_t hold_max_us;
+} lockdep_lock_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#if LOCKDEP_EN
+
+esp_err_t lockdep_init(lockdep_lock_t * p_lock, SemaphoreHandle_t h_sem, const char * p_name);
+BaseType_t lockdep_take(lockdep_lock_t * p_lock, TickType_t ticks);
+BaseType_t lockdep_give(lockdep_lock_t * p_lock);
+uint32_t lockdep_cycles(void);
+void lockdep_dump(void);
+
+#else
+
+static inline esp_err_t
+lockdep_init (lockdep_lock_t * p_lock, SemaphoreHandle_t h_sem, const char * p_name)
+{
+    p_lock->h_sem = h_sem;
+    p_lock->p_name = p_name;
+
+    return ESP_OK;
+}
+
+static inline BaseType_t
+lockdep_take (lockdep_lock_t * p_lock, TickType_t ticks)
+{
+    return xSemaphoreTake(p_lock->h_sem, ticks);
+}
+
+static inline BaseType_t
+lockdep_give (lockdep_lock_t * p_lock)
+{
+    return xSemaphoreGive(p_lock->h_sem);
+}
+
+static inline uint32_t
+lockdep_cycles (void)
+{
+    return 0;
+}
+
+static inline void
+lockdep_dump (void)
+{
+}
+
+#endif /* LOCKDEP_EN */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOCKDEP_H */
@@ -1,8 +1,10 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <freertos/queue.h>
 #include <freertos/semphr.h>
+#include <esp_cpu.h>
 #include <stdio.h>
+#include "../components/blog/blog.h"
+#include "../components/lockdep/lockdep.h"
 
 #define RANDOM_EN           1
 
@@ -14,8 +16,14 @@
 #define N                   4
 #define N_EATERS            (N - 1)
 
-static QueueHandle_t        g_msgq;
-static SemaphoreHandle_t    g_csem;
+// 1: costo di BLOG() misurato all'avvio
+#define BENCH_BLOG          0
+#define BENCH_CALLS         (BLOG_RING_SIZE / 2)
+
+// Periodo di stampa delle statistiche dei lock
+#define LOCKDEP_MS          10000
+
+static lockdep_lock_t       g_csem;
 static int32_t app_cpu = 0;
 
 typedef enum
@@ -39,36 +47,25 @@ typedef struct
     uint32_t        seed;
 } s_phylosopher_t;
 
-typedef struct
-{
-    uint32_t        num;
-    state_t         state;
-} s_message_t;
-
 static s_phylosopher_t philosophers[N];
-static SemaphoreHandle_t forks[N];
-static volatile uint32_t logno = 0;
+static lockdep_lock_t forks[N];
+static char fork_name[N][8];
 
-static BaseType_t
+// Solo puntatore al formato e argomenti nel ring: la stampa avviene nel task
+// di scarico, il filosofo non attende la seriale
+//
+static inline void
 send_state (s_phylosopher_t * philo)
 {
-    s_message_t msg;
-    BaseType_t ret;
-
-    msg.num = philo->num;
-    msg.state = philo->state;
-
-    ret = xQueueSendToBack(g_msgq, &msg, portMAX_DELAY);
-
-    return ret;
+    BLOG("Philosopher %u is %s\n", philo->num, state_name[philo->state]);
 }
 
 static void
 task_philo (void * p_arg)
 {
     s_phylosopher_t * philo = (s_phylosopher_t *) p_arg;
-    SemaphoreHandle_t fork1 = 0;
-    SemaphoreHandle_t fork2 = 0;
+    lockdep_lock_t * fork1 = NULL;
+    lockdep_lock_t * fork2 = NULL;
     BaseType_t ret;
 
     vTaskDelay(pdMS_TO_TICKS(rand_r(&philo->seed) % 20 + 10));
@@ -84,51 +81,64 @@ task_philo (void * p_arg)
         vTaskDelay(pdMS_TO_TICKS(rand_r(&philo->seed) % 20 + 10));
 
 #if PREVENT_DEADLOCK
-        ret = xSemaphoreTake(g_csem, portMAX_DELAY);
+        ret = lockdep_take(&g_csem, portMAX_DELAY);
         assert(pdPASS == ret);
 #endif /* PREVENT_DEADLOCK */
 
-        fork1 = forks[philo->num];
-        fork2 = forks[(philo->num + 1) % N];
-        ret = xSemaphoreTake(fork1, portMAX_DELAY);
+        fork1 = &forks[philo->num];
+        fork2 = &forks[(philo->num + 1) % N];
+        ret = lockdep_take(fork1, portMAX_DELAY);
         assert(pdPASS == ret);
         vTaskDelay(pdMS_TO_TICKS(rand_r(&philo->seed) % 20 + 10));
-        ret = xSemaphoreTake(fork2, portMAX_DELAY);
+        ret = lockdep_take(fork2, portMAX_DELAY);
         assert(pdPASS == ret);
 
         philo->state = EATING;
         send_state(philo);
         vTaskDelay(pdMS_TO_TICKS(rand_r(&philo->seed) % 20 + 10));
 
-        ret = xSemaphoreGive(fork1);
+        ret = lockdep_give(fork1);
         assert(pdPASS == ret);
         vTaskDelay(pdMS_TO_TICKS(1));
-        ret = xSemaphoreGive(fork2);
+        ret = lockdep_give(fork2);
         assert(pdPASS == ret);
 
 #if PREVENT_DEADLOCK
-        ret = xSemaphoreGive(g_csem);
+        ret = lockdep_give(&g_csem);
         assert(pdPASS == ret);
 #endif /* PREVENT_DEADLOCK */
     }
 }
 
+// Riepilogo periodico dei lock: archi d'ordine, cicli, attese e possesso
+//
 static void
-task_loop (void * p_arg)
+task_lockdep (void * p_arg)
 {
-    s_message_t msg;
-
     for (;;)
     {
-        while (pdPASS == xQueueReceive(g_msgq, &msg, 1))
-        {
-            fprintf(stderr, "%05u: Philosopher %u is %s\n",
-                    ++logno, msg.num, state_name[msg.state]);
-        }
+        vTaskDelay(pdMS_TO_TICKS(LOCKDEP_MS));
+        lockdep_dump();
+    }
+}
+
+#if BENCH_BLOG
+static void
+bench_blog (void)
+{
+    uint32_t ccount = 0;
+
+    ccount = esp_cpu_get_ccount();
 
-        ets_delay_us(1000);
+    for (uint32_t idx = 0; idx < BENCH_CALLS; ++idx)
+    {
+        BLOG("bench %u %u\n", idx, ccount);
     }
+
+    ccount = esp_cpu_get_ccount() - ccount;
+    fprintf(stderr, "BLOG: %u cycles per call\n", ccount / BENCH_CALLS);
 }
+#endif /* BENCH_BLOG */
 
 void
 app_main (void)
@@ -136,16 +146,25 @@ app_main (void)
     BaseType_t ret = 0;
     
     app_cpu = xPortGetCoreID();
-    g_msgq = xQueueCreate(30, sizeof(s_message_t));
-    assert(g_msgq != NULL);
 
+#if BENCH_BLOG
+    bench_blog();
+#endif /* BENCH_BLOG */
+
+    // Il filosofo i prende fork i e poi fork i+1: l'ultimo prende fork3 e poi
+    // fork0, e lockdep segnala il ciclo d'ordine anche quando g_csem impedisce
+    // che diventi uno stallo
+    //
     for (uint32_t idx = 0; idx < N; ++idx)
     {
-        forks[idx] = xSemaphoreCreateBinary();
-        assert(forks[idx] != NULL);
-        ret = xSemaphoreGive(forks[idx]);
-        assert(pdPASS == ret);
-        assert(forks[idx] != NULL);
+        // Mutex invece di semaforo binario: chi tiene la forchetta eredita la
+        // priorita' del filosofo che la attende
+        //
+        SemaphoreHandle_t h_sem = xSemaphoreCreateMutex();
+
+        assert(h_sem != NULL);
+        snprintf(fork_name[idx], sizeof(fork_name[idx]), "fork%u", idx);
+        ESP_ERROR_CHECK(lockdep_init(&forks[idx], h_sem, fork_name[idx]));
     }
 
 #if RANDOM_EN
@@ -156,11 +175,10 @@ app_main (void)
     fprintf(stderr, "There are %u philosophers.\n", N);
 
 #if PREVENT_DEADLOCK
-    g_csem = xSemaphoreCreateCounting(N_EATERS, N_EATERS);
-    assert(g_csem != NULL);
+    ESP_ERROR_CHECK(lockdep_init(&g_csem, xSemaphoreCreateCounting(N_EATERS, N_EATERS), "g_csem"));
+    assert(g_csem.h_sem != NULL);
     fprintf(stderr, "With deadlock prevention.\n");
 #else
-    g_csem = NULL;
     fprintf(stderr, "Without deadlock prevention.\n");
 #endif /* PREVENT_DEADLOCK */
 
@@ -185,6 +203,8 @@ app_main (void)
         assert(philosophers[idx].h_task != NULL);
     }
 
-    ret = xTaskCreatePinnedToCore(task_loop, "loop_task", 2048,
-                                  NULL, 1, NULL, app_cpu);
+    ESP_ERROR_CHECK(blog_init(1, app_cpu));
+
+    ret = xTaskCreatePinnedToCore(task_lockdep, "lockdep", 3000, NULL, 1, NULL, app_cpu);
+    assert(pdPASS == ret);
 }
@@ -0,0 +1,201 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <driver/gpio.h>
+#include <esp_timer.h>
+#include <esp_attr.h>
+#include <esp_err.h>
+#include <rom/ets_sys.h>
+#include <stdint.h>
+#include <string.h>
+#include "ranger.h"
+
+static void IRAM_ATTR
+ranger_edge (ranger_sensor_t * p_sensor, uint32_t level, int64_t usecs, BaseType_t * p_woken)
+{
+    TaskHandle_t h_waiter = p_sensor->h_waiter;
+
+    if (level)
+    {
+        p_sensor->rise_us = usecs;
+        return;
+    }
+
+    // Sul fronte di discesa la durata va direttamente nella notifica: il task
+    // non legge piu' il pin.
+    //
+    if ((p_sensor->rise_us != 0) && (h_waiter != NULL))
+    {
+        p_sensor->fall_us = usecs;
+        xTaskNotifyFromISR(h_waiter, (uint32_t) (usecs - p_sensor->rise_us), eSetValueWithOverwrite, p_woken);
+        p_sensor->rise_us = 0;
+    }
+}
+
+static void IRAM_ATTR
+isr_echo (void * p_arg)
+{
+    ranger_sensor_t * p_sensor = (ranger_sensor_t *) p_arg;
+    int64_t now = esp_timer_get_time();
+    BaseType_t woken = pdFALSE;
+
+    ranger_edge(p_sensor, gpio_get_level(p_sensor->cfg.echo), now, &woken);
+
+    if (woken != 0)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+esp_err_t
+ranger_init (ranger_sensor_t * p_sensors, const ranger_config_t * p_cfg, uint32_t n_sensors)
+{
+    esp_err_t ret = ESP_OK;
+
+    ret = gpio_install_isr_service(0);
+
+    if ((ret != ESP_OK) && (ret != ESP_ERR_INVALID_STATE))
+    {
+        return ret;
+    }
+
+    for (uint32_t idx = 0; idx < n_sensors; ++idx)
+    {
+        memset(&p_sensors[idx], 0, sizeof(p_sensors[idx]));
+        p_sensors[idx].cfg = p_cfg[idx];
+
+        if (NULL == p_cfg[idx].p_trigger)
+        {
+            gpio_pad_select_gpio(p_cfg[idx].trigger);
+            ret = gpio_set_direction(p_cfg[idx].trigger, GPIO_MODE_OUTPUT);
+
+            if (ESP_OK == ret)
+            {
+                ret = gpio_set_level(p_cfg[idx].trigger, 0);
+            }
+
+            if (ret != ESP_OK)
+            {
+                return ret;
+            }
+        }
+
+        gpio_pad_select_gpio(p_cfg[idx].echo);
+        ret = gpio_set_direction(p_cfg[idx].echo, GPIO_MODE_INPUT);
+
+        if (ESP_OK == ret)
+        {
+            ret = gpio_set_pull_mode(p_cfg[idx].echo, GPIO_PULLDOWN_ONLY);
+        }
+
+        if (ESP_OK == ret)
+        {
+            ret = gpio_set_intr_type(p_cfg[idx].echo, GPIO_INTR_ANYEDGE);
+        }
+
+        if (ESP_OK == ret)
+        {
+            ret = gpio_isr_handler_add(p_cfg[idx].echo, isr_echo, &p_sensors[idx]);
+        }
+
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+
+    return ESP_OK;
+}
+
+static void
+history_add (ranger_sensor_t * p_sensor, usec_t usecs)
+{
+    p_sensor->history[p_sensor->next] = usecs;
+    p_sensor->next = (p_sensor->next + 1) % RANGER_MEDIAN_N;
+
+    if (p_sensor->n_history < RANGER_MEDIAN_N)
+    {
+        p_sensor->n_history++;
+    }
+}
+
+esp_err_t
+ranger_ping (ranger_sensor_t * p_sensor, usec_t * p_usecs)
+{
+    uint32_t value = 0;
+    BaseType_t ret = pdFALSE;
+
+    if (1 == gpio_get_level(p_sensor->cfg.echo))
+    {
+        return ESP_ERR_INVALID_STATE;   // Ping precedente non terminato
+    }
+
+    // Una notifica rimasta da un'eco tardiva del ping precedente va scartata
+    //
+    p_sensor->rise_us = 0;
+    p_sensor->h_waiter = xTaskGetCurrentTaskHandle();
+    (void) xTaskNotifyWait(0, UINT32_MAX, NULL, 0);
+
+    if (p_sensor->cfg.p_trigger != NULL)
+    {
+        p_sensor->cfg.p_trigger(p_sensor, esp_timer_get_time());
+    }
+    else
+    {
+        gpio_set_level(p_sensor->cfg.trigger, 1);
+        ets_delay_us(10);
+        gpio_set_level(p_sensor->cfg.trigger, 0);
+    }
+
+    // Il task dorme fino al fronte di discesa: attesa dell'eco piu' durata
+    // massima, arrotondata al tick successivo.
+    //
+    ret = xTaskNotifyWait(0, UINT32_MAX, &value, pdMS_TO_TICKS(2 * RANGER_MAX_US / 1000) + 1);
+    p_sensor->h_waiter = NULL;
+
+    if (pdTRUE == ret)
+    {
+        p_sensor->wake_us = (uint32_t) (esp_timer_get_time() - p_sensor->fall_us);
+    }
+
+    if ((pdFALSE == ret) || (0 == value) || (value > RANGER_MAX_US))
+    {
+        p_sensor->n_timeout++;
+        return ESP_ERR_TIMEOUT;
+    }
+
+    p_sensor->n_ok++;
+    history_add(p_sensor, value);
+    *p_usecs = value;
+
+    return ESP_OK;
+}
+
+usec_t
+ranger_median (const ranger_sensor_t * p_sensor)
+{
+    usec_t sorted[RANGER_MEDIAN_N] = {0};
+    uint32_t count = p_sensor->n_history;
+
+    if (0 == count)
+    {
+        return 0;
+    }
+
+    // Insertion sort: la finestra e' di pochi elementi
+    //
+    for (uint32_t idx = 0; idx < count; ++idx)
+    {
+        usec_t usecs = p_sensor->history[idx];
+        uint32_t pos = idx;
+
+        while ((pos > 0) && (sorted[pos - 1] > usecs))
+        {
+            sorted[pos] = sorted[pos - 1];
+            --pos;
+        }
+
+        sorted[pos] = usecs;
+    }
+
+    return sorted[count / 2];
+}
@@ -0,0 +1,57 @@
+#ifndef RANGER_H
+#define RANGER_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <driver/gpio.h>
+#include <esp_err.h>
+#include <stdint.h>
+
+#define RANGER_MEDIAN_N     5       // Finestra del filtro mediano, dispari
+#define RANGER_MAX_US       25000   // Oltre ~4 m l'eco e' considerata assente
+
+typedef uint32_t usec_t;
+
+typedef struct ranger_sensor_s ranger_sensor_t;
+
+// Sostituisce l'impulso sul pin di trigger: permette di generare eco
+// simulate su un'uscita collegata al pin di eco, che resta catturato
+// dall'ISR come con il sensore reale.
+//
+typedef void (* ranger_trigger_t)(ranger_sensor_t * p_sensor, int64_t usecs);
+
+typedef struct
+{
+    gpio_num_t trigger;
+    gpio_num_t echo;
+    ranger_trigger_t p_trigger;     // NULL: impulso sul pin di trigger
+} ranger_config_t;
+
+struct ranger_sensor_s
+{
+    ranger_config_t cfg;
+    volatile int64_t rise_us;       // Fronte di salita dell'eco, 0 se nessuno
+    volatile TaskHandle_t h_waiter; // Task in attesa, NULL fuori dal ping
+    usec_t history[RANGER_MEDIAN_N];
+    uint32_t n_history;
+    uint32_t next;
+    uint32_t n_ok;
+    uint32_t n_timeout;
+    int64_t fall_us;                // Ultimo fronte di discesa consegnato
+    uint32_t wake_us;               // Fronte di discesa -> risveglio del task
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+esp_err_t ranger_init(ranger_sensor_t * p_sensors, const ranger_config_t * p_cfg, uint32_t n_sensors);
+esp_err_t ranger_ping(ranger_sensor_t * p_sensor, usec_t * p_usecs);
+usec_t ranger_median(const ranger_sensor_t * p_sensor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RANGER_H */
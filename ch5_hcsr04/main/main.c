@@ -2,98 +2,221 @@
 #include <freertos/task.h>
 #include <freertos/semphr.h>
 #include <driver/gpio.h>
+#include <esp_timer.h>
+#include <esp_random.h>
 #include <stdio.h>
+#include "../components/ranger/ranger.h"
 
 #define GPIO_LED        GPIO_NUM_14
 #define GPIO_TRIGGER    GPIO_NUM_32
 #define GPIO_ECHO       GPIO_NUM_33
 
-typedef uint32_t usec_t;
+#define GPIO_TRIGGER2   GPIO_NUM_25
+#define GPIO_ECHO2      GPIO_NUM_26
 
+// Sensori interrogati a turno: uno solo alla volta per evitare che l'eco di
+// uno venga ricevuta dall'altro.
+//
+#define N_SENSORS       1
+
+// 1: il sensore 0 e' sostituito da una sequenza di eco simulate generate su
+// GPIO_SIM_ECHO, da collegare con un filo a GPIO_ECHO: i fronti passano dal
+// pin e dall'ISR reali; errori e latenze sono riassunti a ogni giro
+#define SIM_ECHO        0
+#define SIM_JITTER_US   20
+#define GPIO_SIM_ECHO   GPIO_NUM_27
+
+#if SIM_ECHO
+static void sim_trigger(ranger_sensor_t * p_sensor, int64_t usecs);
+#define SIM_TRIGGER     sim_trigger
+#else
+#define SIM_TRIGGER     NULL
+#endif /* SIM_ECHO */
+
+static const ranger_config_t g_ranger_cfg[] = {
+    {GPIO_TRIGGER, GPIO_ECHO, SIM_TRIGGER},
+    {GPIO_TRIGGER2, GPIO_ECHO2, NULL}
+};
+
+static ranger_sensor_t g_sensors[N_SENSORS] = {0};
 static SemaphoreHandle_t gh_barrier = NULL;
 static TickType_t g_repeat_ticks = 100;
 
 static void
-report_cm (usec_t usecs)
+report_cm (uint32_t sensor, usec_t usecs, usec_t median)
 {
     uint32_t dist_cm = 0;
     uint32_t tenths = 0;
 
-    dist_cm = usecs * 10ul / 58ul;
+    dist_cm = median * 10ul / 58ul;
     tenths = dist_cm % 10;
     dist_cm /= 10;
 
-    fprintf(stderr, "Distance %u.%u cm, %u usecs\n", dist_cm, tenths, usecs);
+    fprintf(stderr, "Sensor %u: distance %u.%u cm (median), %u usecs\n", sensor, dist_cm, tenths, usecs);
+}
+
+#if SIM_ECHO
+typedef struct
+{
+    usec_t delay_us;        // Trigger -> fronte di salita
+    usec_t width_us;        // Durata dell'eco, 0 = eco mancante
+} sim_step_t;
+
+static const sim_step_t g_script[] = {
+    {450, 580},             // 10 cm
+    {450, 1160},
+    {450, 5800},            // 1 m
+    {450, 0},
+    {450, 11600},
+    {450, 23200},           // 4 m, limite
+    {450, 30000},           // Fuori portata
+    {2000, 2900},
+    {450, 0},
+    {450, 290}
+};
+
+#define SIM_STEPS   (sizeof(g_script) / sizeof(g_script[0]))
+
+static esp_timer_handle_t gh_sim_rise = NULL;
+static esp_timer_handle_t gh_sim_fall = NULL;
+static ranger_sensor_t * gp_sim_sensor = NULL;
+static uint32_t g_sim_step = 0;
+static usec_t g_sim_width = 0;
+static int64_t g_sim_rise_us = 0;
+static int64_t g_sim_fall_us = 0;
+
+// I fronti sono generati dal task di esp_timer, quindi con il suo ritardo:
+// la durata di riferimento e' quella effettiva fra le due commutazioni.
+//
+static void
+sim_rise (void * p_arg)
+{
+    g_sim_rise_us = esp_timer_get_time();
+    gpio_set_level(GPIO_SIM_ECHO, 1);
+    ESP_ERROR_CHECK(esp_timer_start_once(gh_sim_fall, g_sim_width));
+}
+
+static void
+sim_fall (void * p_arg)
+{
+    g_sim_fall_us = esp_timer_get_time();
+    gpio_set_level(GPIO_SIM_ECHO, 0);
+}
+
+static void
+sim_trigger (ranger_sensor_t * p_sensor, int64_t usecs)
+{
+    const sim_step_t * p_step = &g_script[g_sim_step % SIM_STEPS];
+
+    gp_sim_sensor = p_sensor;
+    g_sim_width = 0;
+    g_sim_rise_us = 0;
+    g_sim_fall_us = 0;
+
+    if (p_step->width_us != 0)
+    {
+        g_sim_width = p_step->width_us + esp_random() % (2 * SIM_JITTER_US + 1) - SIM_JITTER_US;
+        ESP_ERROR_CHECK(esp_timer_start_once(gh_sim_rise, p_step->delay_us));
+    }
+}
+
+static void
+sim_init (void)
+{
+    esp_timer_create_args_t args = {
+        .dispatch_method = ESP_TIMER_TASK,
+    };
+
+    gpio_pad_select_gpio(GPIO_SIM_ECHO);
+    ESP_ERROR_CHECK(gpio_set_direction(GPIO_SIM_ECHO, GPIO_MODE_OUTPUT));
+    ESP_ERROR_CHECK(gpio_set_level(GPIO_SIM_ECHO, 0));
+
+    args.callback = sim_rise;
+    args.name = "sim rise";
+    ESP_ERROR_CHECK(esp_timer_create(&args, &gh_sim_rise));
+
+    args.callback = sim_fall;
+    args.name = "sim fall";
+    ESP_ERROR_CHECK(esp_timer_create(&args, &gh_sim_fall));
 }
 
+// Confronta l'esito del ping con lo script: errore della durata catturata
+// dall'ISR rispetto a quella generata sul pin, latenza fra l'ISR del fronte
+// di discesa e il risveglio del task, esiti sbagliati (eco persa o inventata).
+//
+static void
+sim_check (ranger_sensor_t * p_sensor, esp_err_t err, usec_t usecs)
+{
+    static uint32_t n_wrong = 0;
+    static uint32_t n_measured = 0;
+    static uint64_t err_sum = 0;
+    static uint32_t err_max = 0;
+    static uint32_t wake_max = 0;
+    usec_t width = (usec_t) (g_sim_fall_us - g_sim_rise_us);
+    bool b_expected = (g_sim_width != 0) && (width <= RANGER_MAX_US);
+    uint32_t error = 0;
+
+    if (b_expected != (ESP_OK == err))
+    {
+        n_wrong++;
+    }
+    else if (ESP_OK == err)
+    {
+        error = (usecs > width) ? usecs - width : width - usecs;
+        err_sum += error;
+        err_max = (error > err_max) ? error : err_max;
+        wake_max = (p_sensor->wake_us > wake_max) ? p_sensor->wake_us : wake_max;
+        n_measured++;
+    }
+
+    if (0 == (++g_sim_step % SIM_STEPS))
+    {
+        fprintf(stderr, "sim: %u steps, %u wrong, error avg %llu max %u us, wake max %u us\n",
+                g_sim_step, n_wrong, (n_measured > 0) ? err_sum / n_measured : 0, err_max, wake_max);
+    }
+}
+#endif /* SIM_ECHO */
+
 static void
 task_range (void * argp)
 {
     BaseType_t ret = 0;
+    esp_err_t err = ESP_OK;
     usec_t usecs = 0;
-    int64_t start_us = 0;
-    bool b_timeout = false;
+    uint32_t sensor = 0;
 
     for (;;)
     {
         ret = xSemaphoreTake(gh_barrier, portMAX_DELAY);
         assert(pdPASS == ret);
 
+        // Il task dorme durante la misura: niente piu' attesa attiva sul pin
+        //
         gpio_set_level(GPIO_LED, 1);
-        gpio_set_level(GPIO_TRIGGER, 1);
-        ets_delay_us(10);
-        gpio_set_level(GPIO_TRIGGER, 0);
+        err = ranger_ping(&g_sensors[sensor], &usecs);
+        gpio_set_level(GPIO_LED, 0);
 
-        // Previous ping isn't ended
-        if (1 == gpio_get_level(GPIO_ECHO))
+#if SIM_ECHO
+        if (&g_sensors[sensor] == gp_sim_sensor)
         {
-            fprintf(stderr, "Previous ping not ended\n");
+            sim_check(&g_sensors[sensor], err, usecs);
         }
-        else
+#endif /* SIM_ECHO */
+
+        if (ESP_OK == err)
         {
-            // Wait for echo
-            //
-            start_us = esp_timer_get_time();
-            while (0 == gpio_get_level(GPIO_ECHO))
-            {
-                if ((esp_timer_get_time() - start_us) > 25000L)
-                {
-                    b_timeout = true;
-                    break;
-                }
-            }
-
-            // Got echo, measuring
-            //
-            int64_t echo_start = esp_timer_get_time();
-            int64_t time = echo_start;
-
-            while (1 == gpio_get_level(GPIO_ECHO))
-            {
-                time = esp_timer_get_time();
-
-                if ((time - echo_start) > 25000L)
-                {
-                    b_timeout = true;
-                    break;
-                }
-            }
-
-            usecs = time - echo_start;
+            report_cm(sensor, usecs, ranger_median(&g_sensors[sensor]));
         }
-
-        gpio_set_level(GPIO_LED, 0);
-
-        if ((usecs > 0) && (usecs < 50000L) && (false == b_timeout))
+        else if (ESP_ERR_INVALID_STATE == err)
         {
-            report_cm(usecs);
+            fprintf(stderr, "Sensor %u: previous ping not ended\n", sensor);
         }
         else
         {
-            b_timeout = false;
-            fprintf(stderr, "No echo\n");
+            fprintf(stderr, "Sensor %u: no echo\n", sensor);
         }
 
+        sensor = (sensor + 1) % N_SENSORS;
     }
 }
 
@@ -129,13 +252,11 @@ app_main (void)
     gpio_set_direction(GPIO_LED, GPIO_MODE_OUTPUT);
     gpio_set_level(GPIO_LED, 0);
 
-    gpio_pad_select_gpio(GPIO_TRIGGER);
-    gpio_set_direction(GPIO_TRIGGER, GPIO_MODE_OUTPUT);
-    gpio_set_level(GPIO_TRIGGER, 0);
+#if SIM_ECHO
+    sim_init();
+#endif /* SIM_ECHO */
 
-    gpio_pad_select_gpio(GPIO_ECHO);
-    gpio_set_direction(GPIO_ECHO, GPIO_MODE_INPUT);
-    gpio_set_pull_mode(GPIO_ECHO, GPIO_PULLUP_ENABLE);
+    ESP_ERROR_CHECK(ranger_init(g_sensors, g_ranger_cfg, N_SENSORS));
 
     vTaskDelayUntil(&ticktime, pdMS_TO_TICKS(2000));
 
@@ -0,0 +1,104 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <driver/adc.h>
+#include <esp_timer.h>
+#include <esp_err.h>
+#include <stdint.h>
+#include <string.h>
+#include "adcscan.h"
+
+// Filtro boxcar (CIC del primo ordine) con decimazione 2^n: la somma di 2^n
+// campioni riporta 12 + n/2 bit utili col rumore dell'ADC, il risultato e'
+// scalato a 16 bit.
+//
+static bool
+oversample (adcscan_t * p_scan, adc2_channel_t channel, uint16_t * p_code16)
+{
+    uint32_t n_samples = 1u << p_scan->cfg.oversample_log2;
+    uint32_t sum = 0;
+    int raw = 0;
+
+    for (uint32_t idx = 0; idx < n_samples; ++idx)
+    {
+        if (adc2_get_raw(channel, ADC_WIDTH_BIT_12, &raw) != ESP_OK)
+        {
+            p_scan->n_err++;
+            return false;
+        }
+
+        sum += raw;
+    }
+
+    *p_code16 = (uint16_t) ((sum << 4) >> p_scan->cfg.oversample_log2);
+
+    return true;
+}
+
+static void
+task_scan (void * p_arg)
+{
+    adcscan_t * p_scan = (adcscan_t *) p_arg;
+    TickType_t ticktime = xTaskGetTickCount();
+    int64_t usecs = 0;
+
+    for (;;)
+    {
+        // Tutti i canali in un solo passaggio, con una sola presa del lock
+        //
+        if (p_scan->cfg.p_lock != NULL)
+        {
+            pilock_take(p_scan->cfg.p_lock, portMAX_DELAY);
+        }
+
+        usecs = esp_timer_get_time();
+
+        for (uint32_t idx = 0; idx < p_scan->cfg.n_channels; ++idx)
+        {
+            // Se la lettura fallisce il canale conserva il valore precedente
+            //
+            (void) oversample(p_scan, p_scan->cfg.channels[idx], &p_scan->code16[idx]);
+        }
+
+        p_scan->pass_us = esp_timer_get_time() - usecs;
+
+        if (p_scan->cfg.p_lock != NULL)
+        {
+            pilock_give(p_scan->cfg.p_lock);
+        }
+
+        p_scan->n_pass++;
+        p_scan->cfg.p_cb(p_scan->cfg.p_ctx, p_scan->code16, p_scan->cfg.n_channels);
+
+        vTaskDelayUntil(&ticktime, pdMS_TO_TICKS(p_scan->cfg.period_ms));
+    }
+}
+
+esp_err_t
+adcscan_start (adcscan_t * p_scan, const adcscan_config_t * p_cfg, UBaseType_t prio, BaseType_t core)
+{
+    esp_err_t ret = ESP_OK;
+    BaseType_t task_ret = 0;
+
+    if ((0 == p_cfg->n_channels) || (p_cfg->n_channels > ADCSCAN_MAX_CH)
+        || (p_cfg->oversample_log2 > ADCSCAN_OVERSAMPLE_MAX) || (NULL == p_cfg->p_cb))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(p_scan, 0, sizeof(*p_scan));
+    p_scan->cfg = *p_cfg;
+
+    for (uint32_t idx = 0; idx < p_cfg->n_channels; ++idx)
+    {
+        ret = adc2_config_channel_atten(p_cfg->channels[idx], p_cfg->atten);
+
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+
+    task_ret = xTaskCreatePinnedToCore(task_scan, "adcscan", 2048, p_scan, prio, &p_scan->h_task, core);
+
+    return (pdPASS == task_ret) ? ESP_OK : ESP_ERR_NO_MEM;
+}
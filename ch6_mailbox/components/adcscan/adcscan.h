@@ -0,0 +1,51 @@
+#ifndef ADCSCAN_H
+#define ADCSCAN_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <driver/adc.h>
+#include <esp_err.h>
+#include <stdint.h>
+#include "pilock.h"
+
+#define ADCSCAN_MAX_CH          8
+#define ADCSCAN_OVERSAMPLE_MAX  8       // Al massimo 2^8 campioni per canale
+
+// Risultati a 16 bit: codice a 12 bit con 4 bit frazionari dalla media
+//
+typedef void (* adcscan_cb_t)(void * p_ctx, const uint16_t * p_code16, uint32_t n_channels);
+
+typedef struct
+{
+    adc2_channel_t channels[ADCSCAN_MAX_CH];
+    uint32_t n_channels;
+    adc_atten_t atten;
+    uint32_t oversample_log2;   // 2^n campioni sommati per canale (boxcar)
+    uint32_t period_ms;
+    pilock_t * p_lock;          // Opzionale, tenuto per tutta la scansione
+    adcscan_cb_t p_cb;
+    void * p_ctx;
+} adcscan_config_t;
+
+typedef struct
+{
+    adcscan_config_t cfg;
+    TaskHandle_t h_task;
+    uint16_t code16[ADCSCAN_MAX_CH];
+    uint32_t n_pass;
+    uint32_t n_err;             // Letture fallite (ADC2 occupato dal Wi-Fi)
+    uint32_t pass_us;           // Durata dell'ultima scansione
+} adcscan_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+esp_err_t adcscan_start(adcscan_t * p_scan, const adcscan_config_t * p_cfg, UBaseType_t prio, BaseType_t core);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ADCSCAN_H */
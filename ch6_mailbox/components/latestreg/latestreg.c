@@ -0,0 +1,159 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_attr.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "latestreg.h"
+
+#define SPIN_MAX    64      // Tentativi prima di cedere la CPU al writer
+#define YIELD_MAX   8       // Cessioni prima di dormire un tick
+
+void
+latestreg_init (latestreg_t * p_reg, size_t size, TaskHandle_t h_notify)
+{
+    assert(size <= LATESTREG_MAX_SIZE);
+
+    memset(p_reg, 0, sizeof(*p_reg));
+    p_reg->size = size;
+    p_reg->h_notify = h_notify;
+}
+
+static void IRAM_ATTR
+store (latestreg_t * p_reg, const void * p_val)
+{
+    latestreg_slot_t * p_slot = NULL;
+    uint32_t ticket = 0;
+    uint32_t seq = 0;
+    uint32_t latest = 0;
+
+    // Lo slot si prende solo se contiene un ticket piu' vecchio e nessuno ci
+    // sta scrivendo; altrimenti si prende un nuovo ticket
+    //
+    for (;;)
+    {
+        ticket = __atomic_fetch_add(&p_reg->next, 1, __ATOMIC_RELAXED);
+        p_slot = &p_reg->slots[ticket & (LATESTREG_SLOTS - 1)];
+        seq = __atomic_load_n(&p_slot->seq, __ATOMIC_RELAXED);
+
+        if ((0 == (seq & 1)) && ((int32_t) (seq - (2 * ticket + 1)) < 0)
+            && __atomic_compare_exchange_n(&p_slot->seq, &seq, 2 * ticket + 1, false,
+                                           __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            break;
+        }
+    }
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(p_slot->data, p_val, p_reg->size);
+    __atomic_store_n(&p_slot->seq, 2 * ticket + 2, __ATOMIC_RELEASE);
+
+    // Pubblica solo se nessun ticket piu' recente e' gia' visibile
+    //
+    latest = __atomic_load_n(&p_reg->latest, __ATOMIC_RELAXED);
+
+    while (((int32_t) (latest - (ticket + 1)) < 0)
+           && !__atomic_compare_exchange_n(&p_reg->latest, &latest, ticket + 1, true,
+                                           __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+void
+latestreg_write (latestreg_t * p_reg, const void * p_val)
+{
+    store(p_reg, p_val);
+
+    if (p_reg->h_notify != NULL)
+    {
+        xTaskNotifyGive(p_reg->h_notify);
+    }
+}
+
+void IRAM_ATTR
+latestreg_write_from_isr (latestreg_t * p_reg, const void * p_val, BaseType_t * p_woken)
+{
+    store(p_reg, p_val);
+
+    if (p_reg->h_notify != NULL)
+    {
+        vTaskNotifyGiveFromISR(p_reg->h_notify, p_woken);
+    }
+}
+
+uint32_t
+latestreg_read (latestreg_t * p_reg, void * p_val)
+{
+    const latestreg_slot_t * p_slot = NULL;
+    uint32_t latest = 0;
+    uint32_t seq = 0;
+    uint32_t spins = 0;
+    uint32_t yields = 0;
+
+    for (;;)
+    {
+        latest = __atomic_load_n(&p_reg->latest, __ATOMIC_ACQUIRE);
+
+        if (0 == latest)
+        {
+            return 0;
+        }
+
+        p_slot = &p_reg->slots[(latest - 1) & (LATESTREG_SLOTS - 1)];
+        seq = __atomic_load_n(&p_slot->seq, __ATOMIC_ACQUIRE);
+
+        if (2 * latest == seq)
+        {
+            memcpy(p_val, p_slot->data, p_reg->size);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+            if (__atomic_load_n(&p_slot->seq, __ATOMIC_RELAXED) == seq)
+            {
+                return latest;
+            }
+        }
+
+        // Slot riusato da una scrittura piu' recente non ancora pubblicata:
+        // se il writer e' stato interrotto sullo stesso core gli si cede la
+        // CPU. taskYIELD() basta se il writer ha la stessa priorita'; solo se
+        // e' meno prioritario del lettore serve dormire un tick.
+        //
+        __atomic_fetch_add(&p_reg->n_retry, 1, __ATOMIC_RELAXED);
+
+        if (++spins > SPIN_MAX)
+        {
+            spins = 0;
+
+            if (++yields > YIELD_MAX)
+            {
+                vTaskDelay(1);
+                yields = 0;
+            }
+            else
+            {
+                taskYIELD();
+            }
+        }
+    }
+}
+
+uint32_t
+latestreg_wait (latestreg_t * p_reg, uint32_t version, void * p_val, TickType_t ticks)
+{
+    uint32_t latest = latestreg_read(p_reg, p_val);
+
+    // Solo il task h_notify puo' attendere: la notifica arriva dopo la
+    // pubblicazione, quindi una nuova versione non va mai persa
+    //
+    while (latest == version)
+    {
+        if (0 == ulTaskNotifyTake(pdTRUE, ticks))
+        {
+            break;
+        }
+
+        latest = latestreg_read(p_reg, p_val);
+    }
+
+    return latest;
+}
@@ -0,0 +1,68 @@
+#ifndef LATESTREG_H
+#define LATESTREG_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LATESTREG_SLOTS     4       // Potenza di 2
+#define LATESTREG_MAX_SIZE  32
+
+typedef struct
+{
+    uint32_t seq;           // 2t + 1 in scrittura, 2t + 2 completo (t = ticket)
+    uint8_t data[LATESTREG_MAX_SIZE] __attribute__((aligned(4)));
+} latestreg_slot_t;
+
+// Registro "ultimo valore" senza lock: ogni scrittura prende un ticket e uno
+// slot, i lettori copiano lo slot dell'ultimo ticket pubblicato e ripetono
+// se la sequenza cambia durante la copia. Le scritture non si bloccano mai.
+// Un lettore che trova lo slot a meta' scrittura ripete la copia, poi cede la
+// CPU con taskYIELD(); caso peggiore: se il writer interrotto sullo stesso
+// core ha priorita' minore, il lettore dorme un tick alla volta (vTaskDelay)
+// finche' la scrittura non viene pubblicata.
+//
+typedef struct
+{
+    latestreg_slot_t slots[LATESTREG_SLOTS];
+    uint32_t next;          // Prossimo ticket
+    uint32_t latest;        // Ultimo ticket completo + 1, 0 = mai scritto
+    size_t size;
+    TaskHandle_t h_notify;  // Opzionale: notificato a ogni nuova versione
+    uint32_t n_retry;       // Statistica: letture ripetute
+} latestreg_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+void latestreg_init(latestreg_t * p_reg, size_t size, TaskHandle_t h_notify);
+void latestreg_write(latestreg_t * p_reg, const void * p_val);
+void latestreg_write_from_isr(latestreg_t * p_reg, const void * p_val, BaseType_t * p_woken);
+uint32_t latestreg_read(latestreg_t * p_reg, void * p_val);
+uint32_t latestreg_wait(latestreg_t * p_reg, uint32_t version, void * p_val, TickType_t ticks);
+
+#ifdef __cplusplus
+}
+#endif
+
+// Accessori tipizzati: LATESTREG_TYPED(sens, sens_t) genera sens_write() e
+// sens_read() che controllano il tipo del valore a tempo di compilazione.
+//
+#define LATESTREG_TYPED(name, type)                                         \
+    _Static_assert(sizeof(type) <= LATESTREG_MAX_SIZE, #type " too large"); \
+    static inline void                                                      \
+    name##_write (latestreg_t * p_reg, const type * p_val)                  \
+    {                                                                       \
+        latestreg_write(p_reg, p_val);                                      \
+    }                                                                       \
+    static inline uint32_t                                                  \
+    name##_read (latestreg_t * p_reg, type * p_val)                         \
+    {                                                                       \
+        return latestreg_read(p_reg, p_val);                                \
+    }
+
+#endif /* LATESTREG_H */
@@ -0,0 +1,139 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_attr.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "nfychan.h"
+
+void
+nfy_signal_init (nfy_signal_t * p_sig, TaskHandle_t h_owner, bool b_counting)
+{
+    p_sig->b_counting = b_counting;
+    __atomic_store_n(&p_sig->h_owner, h_owner, __ATOMIC_RELEASE);
+}
+
+BaseType_t
+nfy_signal_give (nfy_signal_t * p_sig)
+{
+    TaskHandle_t h_owner = __atomic_load_n(&p_sig->h_owner, __ATOMIC_ACQUIRE);
+
+    return (h_owner != NULL) ? xTaskNotifyGive(h_owner) : pdFAIL;
+}
+
+void IRAM_ATTR
+nfy_signal_give_from_isr (nfy_signal_t * p_sig, BaseType_t * p_woken)
+{
+    TaskHandle_t h_owner = __atomic_load_n(&p_sig->h_owner, __ATOMIC_ACQUIRE);
+
+    if (h_owner != NULL)
+    {
+        vTaskNotifyGiveFromISR(h_owner, p_woken);
+    }
+}
+
+BaseType_t
+nfy_signal_take (nfy_signal_t * p_sig, TickType_t ticks)
+{
+    assert(xTaskGetCurrentTaskHandle() == p_sig->h_owner);
+
+    // Binario: il contatore torna a zero, conteggio: si decrementa di uno
+    return (ulTaskNotifyTake(p_sig->b_counting ? pdFALSE : pdTRUE, ticks) > 0) ? pdPASS : pdFAIL;
+}
+
+void
+nfy_mbox_init (nfy_mbox_t * p_mbox, TaskHandle_t h_owner)
+{
+    p_mbox->h_owner = h_owner;
+}
+
+BaseType_t
+nfy_mbox_overwrite (nfy_mbox_t * p_mbox, uint32_t value)
+{
+    return xTaskNotify(p_mbox->h_owner, value, eSetValueWithOverwrite);
+}
+
+BaseType_t IRAM_ATTR
+nfy_mbox_overwrite_from_isr (nfy_mbox_t * p_mbox, uint32_t value, BaseType_t * p_woken)
+{
+    return xTaskNotifyFromISR(p_mbox->h_owner, value, eSetValueWithOverwrite, p_woken);
+}
+
+BaseType_t
+nfy_mbox_send (nfy_mbox_t * p_mbox, uint32_t value)
+{
+    // Fallisce se il valore precedente non e' ancora stato letto
+    return xTaskNotify(p_mbox->h_owner, value, eSetValueWithoutOverwrite);
+}
+
+BaseType_t
+nfy_mbox_receive (nfy_mbox_t * p_mbox, uint32_t * p_value, TickType_t ticks)
+{
+    assert(xTaskGetCurrentTaskHandle() == p_mbox->h_owner);
+
+    return xTaskNotifyWait(0, 0, p_value, ticks);
+}
+
+void
+nfy_event_init (nfy_event_t * p_evt, TaskHandle_t h_owner)
+{
+    p_evt->h_owner = h_owner;
+    p_evt->bits = 0;
+}
+
+BaseType_t
+nfy_event_set_bits (nfy_event_t * p_evt, uint32_t bits)
+{
+    return xTaskNotify(p_evt->h_owner, bits, eSetBits);
+}
+
+BaseType_t IRAM_ATTR
+nfy_event_set_bits_from_isr (nfy_event_t * p_evt, uint32_t bits, BaseType_t * p_woken)
+{
+    return xTaskNotifyFromISR(p_evt->h_owner, bits, eSetBits, p_woken);
+}
+
+static bool
+satisfied (uint32_t value, uint32_t bits, bool b_all)
+{
+    return b_all ? ((value & bits) == bits) : ((value & bits) != 0);
+}
+
+uint32_t
+nfy_event_wait_bits (nfy_event_t * p_evt, uint32_t bits, bool b_clear, bool b_all, TickType_t ticks)
+{
+    TickType_t t0 = xTaskGetTickCount();
+    TickType_t elapsed = 0;
+    TickType_t remaining = ticks;
+    uint32_t value = 0;
+    uint32_t result = 0;
+
+    assert(xTaskGetCurrentTaskHandle() == p_evt->h_owner);
+
+    // Il valore di notifica viene svuotato a ogni risveglio e accumulato in
+    // p_evt->bits, come i bit di un event group con un solo lettore.
+    //
+    while (!satisfied(p_evt->bits, bits, b_all))
+    {
+        if (ticks != portMAX_DELAY)
+        {
+            elapsed = xTaskGetTickCount() - t0;
+            remaining = (elapsed < ticks) ? ticks - elapsed : 0;
+        }
+
+        if (xTaskNotifyWait(0, 0xFFFFFFFF, &value, remaining) != pdPASS)
+        {
+            break;
+        }
+
+        p_evt->bits |= value;
+    }
+
+    result = p_evt->bits;
+
+    if (b_clear && satisfied(result, bits, b_all))
+    {
+        p_evt->bits &= ~bits;
+    }
+
+    return result;
+}
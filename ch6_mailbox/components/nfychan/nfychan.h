@@ -0,0 +1,59 @@
+#ifndef NFYCHAN_H
+#define NFYCHAN_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Primitive basate sulla notifica diretta del task proprietario (l'unico che
+// puo' attendere). Ogni task ha un solo valore di notifica: un task puo'
+// possedere una sola primitiva nfychan per volta.
+//
+// Un segnale puo' essere legato dal proprietario nel proprio prologo con
+// nfy_signal_init(p_sig, xTaskGetCurrentTaskHandle(), ...): finche' non e'
+// legato, nfy_signal_give() scarta la notifica.
+//
+typedef struct
+{
+    TaskHandle_t h_owner;
+    bool b_counting;
+} nfy_signal_t;
+
+typedef struct
+{
+    TaskHandle_t h_owner;
+} nfy_mbox_t;
+
+typedef struct
+{
+    TaskHandle_t h_owner;
+    uint32_t bits;          // Bit accumulati, letti e scritti solo dal proprietario
+} nfy_event_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+void nfy_signal_init(nfy_signal_t * p_sig, TaskHandle_t h_owner, bool b_counting);
+BaseType_t nfy_signal_give(nfy_signal_t * p_sig);
+void nfy_signal_give_from_isr(nfy_signal_t * p_sig, BaseType_t * p_woken);
+BaseType_t nfy_signal_take(nfy_signal_t * p_sig, TickType_t ticks);
+
+void nfy_mbox_init(nfy_mbox_t * p_mbox, TaskHandle_t h_owner);
+BaseType_t nfy_mbox_overwrite(nfy_mbox_t * p_mbox, uint32_t value);
+BaseType_t nfy_mbox_overwrite_from_isr(nfy_mbox_t * p_mbox, uint32_t value, BaseType_t * p_woken);
+BaseType_t nfy_mbox_send(nfy_mbox_t * p_mbox, uint32_t value);
+BaseType_t nfy_mbox_receive(nfy_mbox_t * p_mbox, uint32_t * p_value, TickType_t ticks);
+
+void nfy_event_init(nfy_event_t * p_evt, TaskHandle_t h_owner);
+BaseType_t nfy_event_set_bits(nfy_event_t * p_evt, uint32_t bits);
+BaseType_t nfy_event_set_bits_from_isr(nfy_event_t * p_evt, uint32_t bits, BaseType_t * p_woken);
+uint32_t nfy_event_wait_bits(nfy_event_t * p_evt, uint32_t bits, bool b_clear, bool b_all, TickType_t ticks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NFYCHAN_H */
@@ -0,0 +1,98 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_err.h>
+#include <stdint.h>
+#include "pilock.h"
+
+esp_err_t
+pilock_init (pilock_t * p_lock, pilock_mode_t mode, UBaseType_t ceiling)
+{
+    p_lock->mode = mode;
+    p_lock->ceiling = ceiling;
+    p_lock->saved_prio = 0;
+    p_lock->h_owner = NULL;
+
+    if (PILOCK_NONE == mode)
+    {
+        p_lock->h_sem = xSemaphoreCreateBinary();
+
+        if (p_lock->h_sem != NULL)
+        {
+            xSemaphoreGive(p_lock->h_sem);
+        }
+    }
+    else
+    {
+        // Anche con il tetto resta un mutex: l'eredita' copre gli utenti con
+        // priorita' sopra il tetto dichiarato
+        //
+        p_lock->h_sem = xSemaphoreCreateMutex();
+    }
+
+    return (p_lock->h_sem != NULL) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void
+pilock_deinit (pilock_t * p_lock)
+{
+    // Un lock a tetto cancellato mentre e' preso lascerebbe il proprietario
+    // al tetto per sempre: gli si restituisce la priorita' salvata alla presa.
+    // Il proprietario, se c'e', deve essere ancora vivo.
+    //
+    if ((PILOCK_CEILING == p_lock->mode) && (p_lock->h_owner != NULL) &&
+        (p_lock->saved_prio < p_lock->ceiling))
+    {
+        vTaskPrioritySet(p_lock->h_owner, p_lock->saved_prio);
+    }
+
+    vSemaphoreDelete(p_lock->h_sem);
+    p_lock->h_sem = NULL;
+    p_lock->h_owner = NULL;
+}
+
+BaseType_t
+pilock_take (pilock_t * p_lock, TickType_t ticks)
+{
+    UBaseType_t prio = uxTaskPriorityGet(NULL);
+    BaseType_t ret = 0;
+
+    // Tetto immediato: si alza la priorita' prima di prendere il lock, cosi'
+    // nessun task sotto il tetto puo' prelazionare il proprietario
+    //
+    if ((PILOCK_CEILING == p_lock->mode) && (prio < p_lock->ceiling))
+    {
+        vTaskPrioritySet(NULL, p_lock->ceiling);
+    }
+
+    ret = xSemaphoreTake(p_lock->h_sem, ticks);
+
+    if (pdPASS == ret)
+    {
+        p_lock->saved_prio = prio;
+        p_lock->h_owner = xTaskGetCurrentTaskHandle();
+    }
+    else if ((PILOCK_CEILING == p_lock->mode) && (prio < p_lock->ceiling))
+    {
+        vTaskPrioritySet(NULL, prio);
+    }
+
+    return ret;
+}
+
+BaseType_t
+pilock_give (pilock_t * p_lock)
+{
+    UBaseType_t prio = p_lock->saved_prio;
+    BaseType_t ret = 0;
+
+    p_lock->h_owner = NULL;
+    ret = xSemaphoreGive(p_lock->h_sem);
+
+    if ((PILOCK_CEILING == p_lock->mode) && (prio < p_lock->ceiling))
+    {
+        vTaskPrioritySet(NULL, prio);
+    }
+
+    return ret;
+}
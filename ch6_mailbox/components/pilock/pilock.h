@@ -0,0 +1,41 @@
+#ifndef PILOCK_H
+#define PILOCK_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_err.h>
+#include <stdint.h>
+
+typedef enum
+{
+    PILOCK_INHERIT = 0,     // Mutex FreeRTOS: il proprietario eredita la priorita' di chi attende
+    PILOCK_CEILING,         // Il proprietario sale subito al tetto per tutta la sezione critica
+    PILOCK_NONE             // Semaforo binario senza eredita', solo per confronto
+} pilock_mode_t;
+
+typedef struct
+{
+    SemaphoreHandle_t h_sem;
+    pilock_mode_t mode;
+    UBaseType_t ceiling;    // Solo PILOCK_CEILING: massima priorita' degli utenti
+    UBaseType_t saved_prio; // Priorita' del proprietario prima della presa
+                            // (non prendere un lock a tetto mentre si eredita)
+    TaskHandle_t h_owner;
+} pilock_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+esp_err_t pilock_init(pilock_t * p_lock, pilock_mode_t mode, UBaseType_t ceiling);
+void pilock_deinit(pilock_t * p_lock);
+BaseType_t pilock_take(pilock_t * p_lock, TickType_t ticks);
+BaseType_t pilock_give(pilock_t * p_lock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PILOCK_H */
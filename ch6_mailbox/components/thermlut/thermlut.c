@@ -0,0 +1,31 @@
+#include <math.h>
+#include <stdint.h>
+#include "thermlut.h"
+
+// Il calcolo in double (senza FPU) si fa una sola volta per codice: dopo la
+// conversione e' un accesso alla tabella.
+//
+void
+thermlut_init (thermlut_t * p_lut, const thermlut_coeff_t * p_coeff)
+{
+    double rth_log = 0.0;
+    double temp = 0.0;
+
+    for (uint32_t code = 0; code < THERMLUT_SIZE; ++code)
+    {
+        rth_log = log(p_coeff->r_series * THERMLUT_SIZE / code - p_coeff->r_series);
+        temp = 1.0 / (p_coeff->a + (p_coeff->b + (p_coeff->c * rth_log * rth_log)) * rth_log);
+        temp = round((temp - 273.15) * 100.0);
+
+        if (temp > INT16_MAX)
+        {
+            temp = INT16_MAX;
+        }
+        else if (temp < INT16_MIN)
+        {
+            temp = INT16_MIN;
+        }
+
+        p_lut->centi[code] = (int16_t) temp;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef THERMLUT_H
+#define THERMLUT_H
+
+#include <stdint.h>
+
+#define THERMLUT_SIZE   4096    // Un elemento per ogni codice dell'ADC a 12 bit
+
+// Coefficienti di Steinhart-Hart e resistenza del partitore (termistore
+// verso massa, r_series verso l'alimentazione)
+//
+typedef struct
+{
+    double a;
+    double b;
+    double c;
+    double r_series;
+} thermlut_coeff_t;
+
+typedef struct
+{
+    int16_t centi[THERMLUT_SIZE];   // Centesimi di grado, saturati a int16
+} thermlut_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+void thermlut_init(thermlut_t * p_lut, const thermlut_coeff_t * p_coeff);
+
+static inline int32_t
+thermlut_centi (const thermlut_t * p_lut, uint32_t code)
+{
+    return p_lut->centi[code & (THERMLUT_SIZE - 1)];
+}
+
+// Codice a 16 bit (12 interi + 4 frazionari, da sovracampionamento):
+// interpolazione lineare fra due elementi adiacenti
+//
+static inline int32_t
+thermlut_centi16 (const thermlut_t * p_lut, uint32_t code16)
+{
+    uint32_t code = (code16 >> 4) & (THERMLUT_SIZE - 1);
+    int32_t frac = code16 & 0xF;
+    int32_t base = p_lut->centi[code];
+
+    if (THERMLUT_SIZE - 1 == code)
+    {
+        return base;
+    }
+
+    return base + (((p_lut->centi[code + 1] - base) * frac + 8) >> 4);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* THERMLUT_H */
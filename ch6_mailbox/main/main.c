@@ -1,30 +1,70 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
 #include <freertos/task.h>
-#include <freertos/semphr.h>
 #include <driver/adc.h>
+#include <esp_timer.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include "../components/nfychan/nfychan.h"
+#include "../components/thermlut/thermlut.h"
+#include "../components/adcscan/adcscan.h"
+#include "../components/latestreg/latestreg.h"
+#include "../components/pilock/pilock.h"
 
 #define PIN_S1  GPIO_NUM_12
 #define PIN_S2  GPIO_NUM_13
 
+// 1: confronto di costo e precisione fra tabella e calcolo in double
+#define BENCH_THERM 0
+
+#define SCAN_MS         500
+#define OVERSAMPLE_LOG2 6       // 64 campioni per canale e per scansione
+
+// 1: latenza registro/coda e stress test con writer e reader su entrambi i core
+#define BENCH_REG   0
+#define BENCH_LOOPS 10000
+#define STRESS_MS   3000
+
+// 1: blocco peggiore di un task ad alta priorita' con inversione provocata da
+// un task medio, per semaforo binario, eredita' e tetto
+//
+#define BENCH_INVERSION 0
+#define INV_ROUNDS      20
+#define INV_HOLD_US     2000
+#define INV_SPIN_US     20000
+#define INV_PRIO_LOW    2
+#define INV_PRIO_MED    3
+#define INV_PRIO_HIGH   4
+
 static int32_t              g_app_cpu = 0;
-static QueueHandle_t        gh_queue_sens1 = NULL;
-static QueueHandle_t        gh_queue_sens2 = NULL;
-static SemaphoreHandle_t    gh_sem_disp = NULL;
-static SemaphoreHandle_t    gh_sem_comm = NULL;
+static latestreg_t          g_reg_sens1 = {0};
+static latestreg_t          g_reg_sens2 = {0};
+static nfy_signal_t         g_sig_disp = {0};
+static pilock_t             g_lock_adc = {0};
+static thermlut_t           g_thermlut = {0};
+static adcscan_t            g_scan = {0};
+
+static const thermlut_coeff_t g_therm_coeff = {
+    .a = 1.129148e-3,
+    .b = 2.34125e-4,
+    .c = 8.76741e-8,
+    .r_series = 10000.0
+};
 
 typedef struct
 {
-    float    temp;
+    int32_t  centi;     // Centesimi di grado
 } sens1_t;
 
 typedef struct
 {
-    float    temp;
+    int32_t  centi;
 } sens2_t;
 
+LATESTREG_TYPED(sens1, sens1_t)
+LATESTREG_TYPED(sens2, sens2_t)
+
 double
 thermistor (int32_t adc_raw)
 {
@@ -40,100 +80,415 @@ thermistor (int32_t adc_raw)
     return temp;
 }
 
-static inline BaseType_t
-lock_resource (void)
+#if BENCH_THERM
+static void
+bench_therm (void)
 {
-    BaseType_t ret = 0;
+    volatile double sink_d = 0.0;
+    volatile int32_t sink_i = 0;
+    double err = 0.0;
+    double err_max = 0.0;
+    double coarse_max = 0.0;
+    uint32_t err_code = 0;
+    uint32_t coarse_code = 0;
+    uint32_t n_sat = 0;
+    int64_t usecs = 0;
+
+    // Precisione su tutti i codici, esclusi quelli fuori dal campo int16.
+    // Per confronto, una tabella da 257 elementi (un codice ogni 16) con
+    // interpolazione lineare: l'errore cresce dove la curva e' ripida.
+    //
+    for (uint32_t code = 0; code < THERMLUT_SIZE; ++code)
+    {
+        double ref = thermistor(code) * 100.0;
+        uint32_t lo = code & ~15u;
+        uint32_t hi = (lo + 16 < THERMLUT_SIZE) ? lo + 16 : THERMLUT_SIZE - 1;
+        double coarse = thermlut_centi(&g_thermlut, lo);
 
-    ret = xSemaphoreTake(gh_sem_comm, portMAX_DELAY);
-    assert(pdPASS == ret);
+        if ((ref < INT16_MIN) || (ref > INT16_MAX))
+        {
+            n_sat++;
+            continue;
+        }
+
+        err = fabs(thermlut_centi(&g_thermlut, code) - ref);
+
+        if (err > err_max)
+        {
+            err_max = err;
+            err_code = code;
+        }
+
+        if (hi > lo)
+        {
+            coarse += (double) (thermlut_centi(&g_thermlut, hi) - coarse) * (code - lo) / (hi - lo);
+        }
+
+        err = fabs(coarse - ref);
+
+        if (err > coarse_max)
+        {
+            coarse_max = err;
+            coarse_code = code;
+        }
+    }
+
+    printf("thermlut: max error %.3f centi-C at code %u, %u saturated codes\n", err_max, err_code, n_sat);
+    printf("257-entry: max error %.3f centi-C at code %u\n", coarse_max, coarse_code);
+
+    usecs = esp_timer_get_time();
+
+    for (uint32_t code = 0; code < THERMLUT_SIZE; ++code)
+    {
+        sink_d = thermistor(code);
+    }
+
+    usecs = esp_timer_get_time() - usecs;
+    printf("double:   %lld ns per conversion\n", usecs * 1000 / THERMLUT_SIZE);
+
+    usecs = esp_timer_get_time();
+
+    for (uint32_t code = 0; code < THERMLUT_SIZE; ++code)
+    {
+        sink_i = thermlut_centi(&g_thermlut, code);
+    }
+
+    usecs = esp_timer_get_time() - usecs;
+    printf("thermlut: %lld ns per conversion\n", usecs * 1000 / THERMLUT_SIZE);
+
+    (void) sink_d;
+    (void) sink_i;
+}
+#endif /* BENCH_THERM */
+
+#if BENCH_REG
+typedef struct
+{
+    uint32_t a;
+    uint32_t b;             // ~a
+    uint32_t c;             // a * STRESS_K
+    uint32_t writer;
+} stress_t;
+
+#define STRESS_K    2654435761u
+
+static latestreg_t g_reg_stress = {0};
+static volatile bool g_b_stop = false;
+static uint32_t g_n_done = 0;
+static uint32_t g_n_writes = 0;
+static uint32_t g_n_torn = 0;
+static uint32_t g_n_reads = 0;
+static uint32_t g_n_stale = 0;
+
+static void
+task_stress_writer (void * p_arg)
+{
+    stress_t val = {0};
+    uint32_t writes = 0;
+
+    val.writer = (uint32_t) (uintptr_t) p_arg;
+
+    for (uint32_t idx = 1; !g_b_stop; ++idx)
+    {
+        val.a = idx;
+        val.b = ~idx;
+        val.c = idx * STRESS_K;
+        latestreg_write(&g_reg_stress, &val);
+        ++writes;
+
+        if (0 == (idx & 1023))
+        {
+            vTaskDelay(1);
+        }
+    }
+
+    // next conta i ticket, anche quelli scartati per slot occupato
+    //
+    __atomic_fetch_add(&g_n_writes, writes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_n_done, 1, __ATOMIC_RELAXED);
+    vTaskDelete(NULL);
+}
+
+static void
+task_stress_reader (void * p_arg)
+{
+    bool b_wait = (bool) p_arg;
+    stress_t val = {0};
+    uint32_t version = 0;
+    uint32_t last = 0;
+
+    // Il reader in attesa si registra da se': le scritture precedenti non
+    // notificano nessuno, latestreg_wait() le vede comunque alla prima lettura
+    //
+    if (b_wait)
+    {
+        __atomic_store_n(&g_reg_stress.h_notify, xTaskGetCurrentTaskHandle(), __ATOMIC_RELEASE);
+    }
+
+    // Un reader usa la notifica "changed", l'altro legge in polling
+    //
+    for (uint32_t idx = 1; !g_b_stop; ++idx)
+    {
+        version = b_wait ? latestreg_wait(&g_reg_stress, last, &val, 1)
+                         : latestreg_read(&g_reg_stress, &val);
+
+        if (0 == version)
+        {
+            continue;
+        }
+
+        if ((val.b != ~val.a) || (val.c != val.a * STRESS_K))
+        {
+            __atomic_fetch_add(&g_n_torn, 1, __ATOMIC_RELAXED);
+        }
+
+        if ((int32_t) (version - last) < 0)
+        {
+            __atomic_fetch_add(&g_n_stale, 1, __ATOMIC_RELAXED);
+        }
+
+        last = version;
+        __atomic_fetch_add(&g_n_reads, 1, __ATOMIC_RELAXED);
+
+        if (0 == (idx & 1023))
+        {
+            vTaskDelay(1);
+        }
+    }
 
-    return ret;
+    __atomic_fetch_add(&g_n_done, 1, __ATOMIC_RELAXED);
+    vTaskDelete(NULL);
 }
 
-static inline BaseType_t
-unlock_resource (void)
+static void
+bench_reg (void)
 {
+    QueueHandle_t h_queue = xQueueCreate(1, sizeof(sens1_t));
+    sens1_t reading = {0};
+    int64_t usecs = 0;
     BaseType_t ret = 0;
 
-    ret = xSemaphoreGive(gh_sem_comm);
+    assert(h_queue != NULL);
+
+    usecs = esp_timer_get_time();
+
+    for (uint32_t idx = 0; idx < BENCH_LOOPS; ++idx)
+    {
+        reading.centi = idx;
+        xQueueOverwrite(h_queue, &reading);
+        xQueuePeek(h_queue, &reading, 0);
+    }
+
+    usecs = esp_timer_get_time() - usecs;
+    printf("queue:     %lld ns per overwrite+peek\n", usecs * 1000 / BENCH_LOOPS);
+    vQueueDelete(h_queue);
+
+    usecs = esp_timer_get_time();
+
+    for (uint32_t idx = 0; idx < BENCH_LOOPS; ++idx)
+    {
+        reading.centi = idx;
+        sens1_write(&g_reg_sens1, &reading);
+        sens1_read(&g_reg_sens1, &reading);
+    }
+
+    usecs = esp_timer_get_time() - usecs;
+    printf("latestreg: %lld ns per write+read\n", usecs * 1000 / BENCH_LOOPS);
+
+    // Due writer e due reader, uno per core ciascuno
+    //
+    latestreg_init(&g_reg_stress, sizeof(stress_t), NULL);
+
+    ret = xTaskCreatePinnedToCore(task_stress_reader, "rd0", 2048, (void *) true, 1, NULL, 0);
+    assert(pdPASS == ret);
+    ret = xTaskCreatePinnedToCore(task_stress_reader, "rd1", 2048, (void *) false, 1, NULL, 1);
     assert(pdPASS == ret);
+    ret = xTaskCreatePinnedToCore(task_stress_writer, "wr0", 2048, (void *) 0, 1, NULL, 0);
+    assert(pdPASS == ret);
+    ret = xTaskCreatePinnedToCore(task_stress_writer, "wr1", 2048, (void *) 1, 1, NULL, 1);
+    assert(pdPASS == ret);
+
+    vTaskDelay(pdMS_TO_TICKS(STRESS_MS));
+    g_b_stop = true;
+
+    while (__atomic_load_n(&g_n_done, __ATOMIC_RELAXED) < 4)
+    {
+        vTaskDelay(1);
+    }
+
+    printf("stress: %u writes (%u tickets), %u reads, %u torn, %u stale, %u retries\n",
+           g_n_writes, g_reg_stress.next, g_n_reads, g_n_torn, g_n_stale, g_reg_stress.n_retry);
 
-    return ret;
+    latestreg_init(&g_reg_sens1, sizeof(sens1_t), NULL);
 }
+#endif /* BENCH_REG */
+
+#if BENCH_INVERSION
+typedef struct
+{
+    pilock_t lock;
+    TaskHandle_t h_high;
+    TaskHandle_t h_med;
+    TaskHandle_t h_main;
+    int64_t start;          // Presa del lock da parte del task basso
+    int64_t block_max;      // Blocco peggiore visto dal task alto
+} inv_bench_t;
+
+static inv_bench_t g_inv = {0};
 
 static void
-task_temp1 (void * p_arg)
+spin_us (int64_t usecs)
 {
-    sens1_t reading;
-    BaseType_t ret = 0;
-    int32_t raw_reading = 0;
+    int64_t end = esp_timer_get_time() + usecs;
+
+    while (esp_timer_get_time() < end)
+    {
+    }
+}
+
+static void
+task_inv_high (void * p_arg)
+{
+    int64_t block = 0;
 
     for (;;)
     {
-        lock_resource();
-        adc2_get_raw(ADC2_CHANNEL_5, ADC_WIDTH_BIT_12, &raw_reading);
-        unlock_resource();
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        pilock_take(&g_inv.lock, portMAX_DELAY);
+        block = esp_timer_get_time() - g_inv.start;
+        pilock_give(&g_inv.lock);
 
-        reading.temp = thermistor(raw_reading);
-        ret = xQueueOverwrite(gh_queue_sens1, &reading);
-        assert(pdPASS == ret);
+        if (block > g_inv.block_max)
+        {
+            g_inv.block_max = block;
+        }
+    }
+}
 
-        xSemaphoreGive(gh_sem_disp);
+static void
+task_inv_med (void * p_arg)
+{
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        spin_us(INV_SPIN_US);
+    }
+}
 
-        vTaskDelay(pdMS_TO_TICKS(500));
+// Il task basso prende il lock e sveglia gli altri due: senza eredita' il
+// task medio lo prelaziona e il task alto attende anche INV_SPIN_US
+//
+static void
+task_inv_low (void * p_arg)
+{
+    for (uint32_t round = 0; round < INV_ROUNDS; ++round)
+    {
+        pilock_take(&g_inv.lock, portMAX_DELAY);
+        g_inv.start = esp_timer_get_time();
+        xTaskNotifyGive(g_inv.h_high);
+        xTaskNotifyGive(g_inv.h_med);
+        spin_us(INV_HOLD_US);
+        pilock_give(&g_inv.lock);
+
+        vTaskDelay(pdMS_TO_TICKS(INV_SPIN_US / 1000 + 10));
     }
+
+    xTaskNotifyGive(g_inv.h_main);
+    vTaskDelete(NULL);
 }
 
 static void
-task_temp2 (void * p_arg)
+bench_inversion (void)
 {
-    sens2_t reading;
+    static const char * mode_name[] = {"inherit", "ceiling", "binary"};
+    static const pilock_mode_t modes[] = {PILOCK_NONE, PILOCK_INHERIT, PILOCK_CEILING};
+    pilock_mode_t mode = PILOCK_INHERIT;
     BaseType_t ret = 0;
-    int32_t raw_reading = 0;
 
-    for (;;)
+    for (uint32_t idx = 0; idx < 3; ++idx)
     {
-        lock_resource();
-        adc2_get_raw(ADC2_CHANNEL_4, ADC_WIDTH_BIT_12, &raw_reading);
-        unlock_resource();
+        mode = modes[idx];
+
+        ESP_ERROR_CHECK(pilock_init(&g_inv.lock, mode, INV_PRIO_HIGH));
+        g_inv.block_max = 0;
+        g_inv.h_main = xTaskGetCurrentTaskHandle();
 
-        reading.temp = thermistor(raw_reading);
-        ret = xQueueOverwrite(gh_queue_sens2, &reading);
+        // Tutti sullo stesso core, altrimenti il task medio non prelaziona
+        //
+        ret = xTaskCreatePinnedToCore(task_inv_high, "inv_hi", 2048, NULL, INV_PRIO_HIGH, &g_inv.h_high, g_app_cpu);
+        assert(pdPASS == ret);
+        ret = xTaskCreatePinnedToCore(task_inv_med, "inv_med", 2048, NULL, INV_PRIO_MED, &g_inv.h_med, g_app_cpu);
+        assert(pdPASS == ret);
+        ret = xTaskCreatePinnedToCore(task_inv_low, "inv_lo", 2048, NULL, INV_PRIO_LOW, NULL, g_app_cpu);
         assert(pdPASS == ret);
 
-        xSemaphoreGive(gh_sem_disp);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-        vTaskDelay(pdMS_TO_TICKS(500));
+        vTaskDelete(g_inv.h_high);
+        vTaskDelete(g_inv.h_med);
+        pilock_deinit(&g_inv.lock);
+
+        printf("inversion %-7s: worst block %lld us (hold %u us, medium %u us)\n",
+               mode_name[mode], g_inv.block_max, INV_HOLD_US, INV_SPIN_US);
     }
 }
+#endif /* BENCH_INVERSION */
+
+static void
+print_temp (const char * p_name, int32_t centi)
+{
+    printf("%s = %s%d.%02dC \n", p_name, (centi < 0) ? "-" : "", abs(centi) / 100, abs(centi) % 100);
+}
+
+// Una sola scansione per entrambi i termistori: canale 0 -> T1, 1 -> T2
+//
+static void
+scan_done (void * p_ctx, const uint16_t * p_code16, uint32_t n_channels)
+{
+    sens1_t reading1 = {0};
+    sens2_t reading2 = {0};
+
+    reading1.centi = thermlut_centi16(&g_thermlut, p_code16[0]);
+    sens1_write(&g_reg_sens1, &reading1);
+
+    reading2.centi = thermlut_centi16(&g_thermlut, p_code16[1]);
+    sens2_write(&g_reg_sens2, &reading2);
+
+    // Un solo risveglio del display per entrambi i registri
+    //
+    nfy_signal_give(&g_sig_disp);
+}
 
 static void
 task_disp (void * p_arg)
 {
+    nfy_signal_t * p_sig = (nfy_signal_t *) p_arg;
     sens1_t temp1_reading;
     sens2_t temp2_reading;
     BaseType_t ret = 0;
 
+    // Il segnale si lega qui: una scansione completata prima di questo punto
+    // non trova il proprietario e la sua notifica va persa, la successiva no
+    //
+    nfy_signal_init(p_sig, xTaskGetCurrentTaskHandle(), false);
+
     for (;;)
     {
-        ret = xSemaphoreTake(gh_sem_disp, portMAX_DELAY);
+        ret = nfy_signal_take(p_sig, portMAX_DELAY);
         assert(pdPASS == ret);
 
-        ret = xQueuePeek(gh_queue_sens1, &temp1_reading, 0);
-        if (pdPASS == ret)
+        if (sens1_read(&g_reg_sens1, &temp1_reading) != 0)
         {
-            printf("T1 = %4.2fC \n", temp1_reading.temp);
+            print_temp("T1", temp1_reading.centi);
         }
         else
         {
             printf("T1 not available \n");
         }
 
-        ret = xQueuePeek(gh_queue_sens2, &temp2_reading, 0);
-        if (pdPASS == ret)
+        if (sens2_read(&g_reg_sens2, &temp2_reading) != 0)
         {
-            printf("T2 = %4.2fC \n", temp2_reading.temp);
+            print_temp("T2", temp2_reading.centi);
         }
         else
         {
@@ -146,28 +501,50 @@ void
 app_main (void)
 {
     BaseType_t ret = 0;
+    adcscan_config_t scan_cfg = {
+        .channels = {ADC2_CHANNEL_5, ADC2_CHANNEL_4},
+        .n_channels = 2,
+        .atten = ADC_ATTEN_DB_11,
+        .oversample_log2 = OVERSAMPLE_LOG2,
+        .period_ms = SCAN_MS,
+        .p_cb = scan_done,
+    };
 
     g_app_cpu = xPortGetCoreID();
-    gh_sem_disp = xSemaphoreCreateBinary();
-    assert(gh_sem_disp != NULL);
 
-    gh_sem_comm = xSemaphoreCreateBinary();
-    assert(gh_sem_comm != NULL);
-    ret = xSemaphoreGive(gh_sem_comm);
-    assert(pdPASS == ret);
+    thermlut_init(&g_thermlut, &g_therm_coeff);
+
+#if BENCH_THERM
+    bench_therm();
+#endif /* BENCH_THERM */
+
+    // Mutex con eredita': un utente ad alta priorita' dell'ADC2 non resta
+    // bloccato dietro a task medi mentre la scansione tiene il lock
+    //
+    ESP_ERROR_CHECK(pilock_init(&g_lock_adc, PILOCK_INHERIT, 0));
 
-    gh_queue_sens1 = xQueueCreate(1, sizeof(sens1_t));
-    assert(gh_queue_sens1 != NULL);
-    gh_queue_sens2 = xQueueCreate(1, sizeof(sens2_t));
-    assert(gh_queue_sens2 != NULL);
+    latestreg_init(&g_reg_sens1, sizeof(sens1_t), NULL);
+    latestreg_init(&g_reg_sens2, sizeof(sens2_t), NULL);
+
+#if BENCH_REG
+    bench_reg();
+#endif /* BENCH_REG */
+
+#if BENCH_INVERSION
+    bench_inversion();
+#endif /* BENCH_INVERSION */
 
     vTaskDelay(pdMS_TO_TICKS(2000));
 
-    ret = xTaskCreatePinnedToCore(task_temp1, "temp1", 2048, NULL, 1, NULL, g_app_cpu);
-    assert(pdPASS == ret);
-    ret = xTaskCreatePinnedToCore(task_temp2, "temp2", 2048, NULL, 1, NULL, g_app_cpu);
+    // Il segnale di aggiornamento notifica direttamente il task display, che
+    // lo lega al proprio handle appena parte
+    //
+    ret = xTaskCreatePinnedToCore(task_disp, "display", 4092, &g_sig_disp, 1, NULL, g_app_cpu);
     assert(pdPASS == ret);
 
-    ret = xTaskCreatePinnedToCore(task_disp, "display", 4092, NULL, 1, NULL, g_app_cpu);
-    assert(pdPASS == ret);
+    // Il lock resta per gli altri utenti dell'ADC2: la scansione lo prende una
+    // volta per passaggio invece che una volta per campione
+    //
+    scan_cfg.p_lock = &g_lock_adc;
+    ESP_ERROR_CHECK(adcscan_start(&g_scan, &scan_cfg, 1, g_app_cpu));
 }
\ No newline at end of file
@@ -0,0 +1,355 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <driver/i2c.h>
+#include <esp_timer.h>
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "i2cprof.h"
+
+#if I2CPROF_ENABLE
+
+#if I2CPROF_TLS_INDEX >= configNUM_THREAD_LOCAL_STORAGE_POINTERS
+#   error "I2CPROF_TLS_INDEX: aumentare CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS"
+#endif
+
+#define N_ADDR      128
+
+typedef struct
+{
+    char name[configMAX_TASK_NAME_LEN];
+    bool b_ready;           // Nome valido, lo slot puo' essere esportato
+    int64_t t_locked;
+    uint32_t seq;           // Dispari durante un aggiornamento (seqlock)
+    uint32_t gen;           // Periodo di report a cui si riferiscono le stats
+    i2cprof_task_stats_t stats;
+} task_slot_t;
+
+// Ogni slot task e' scritto solo dal task proprietario e letto dal report
+// con un seqlock. Il report non azzera gli slot: avanza g_gen e il task
+// proprietario riparte da zero al primo aggiornamento del nuovo periodo.
+// I contatori per indirizzo sono condivisi e aggiornati con operazioni
+// atomiche, il report sottrae l'istantanea del periodo precedente.
+//
+static task_slot_t g_tasks[I2CPROF_MAX_TASKS] = {0};
+static uint32_t g_n_tasks = 0;
+static uint32_t g_gen = 0;
+static i2cprof_addr_stats_t g_addrs[N_ADDR] = {0};
+static i2cprof_addr_stats_t g_addrs_base[N_ADDR] = {0};
+static uint32_t g_period_ms = 0;
+
+static task_slot_t *
+task_slot (void)
+{
+    task_slot_t * p_slot = (task_slot_t *) pvTaskGetThreadLocalStoragePointer(NULL, I2CPROF_TLS_INDEX);
+    uint32_t idx = 0;
+
+    if (NULL == p_slot)
+    {
+        idx = __atomic_load_n(&g_n_tasks, __ATOMIC_RELAXED);
+
+        do
+        {
+            if (idx >= I2CPROF_MAX_TASKS)
+            {
+                // Tabella piena: i task in eccesso non vengono profilati
+                return NULL;
+            }
+        }
+        while (!__atomic_compare_exchange_n(&g_n_tasks, &idx, idx + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+        p_slot = &g_tasks[idx];
+        strncpy(p_slot->name, pcTaskGetTaskName(NULL), sizeof(p_slot->name) - 1);
+        p_slot->gen = __atomic_load_n(&g_gen, __ATOMIC_RELAXED);
+        __atomic_store_n(&p_slot->b_ready, true, __ATOMIC_RELEASE);
+        vTaskSetThreadLocalStoragePointer(NULL, I2CPROF_TLS_INDEX, p_slot);
+    }
+
+    return p_slot;
+}
+
+static void
+slot_begin (task_slot_t * p_slot)
+{
+    uint32_t gen = __atomic_load_n(&g_gen, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&p_slot->seq, p_slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if (p_slot->gen != gen)
+    {
+        memset(&p_slot->stats, 0, sizeof(p_slot->stats));
+        p_slot->gen = gen;
+    }
+}
+
+static void
+slot_end (task_slot_t * p_slot)
+{
+    __atomic_store_n(&p_slot->seq, p_slot->seq + 1, __ATOMIC_RELEASE);
+}
+
+static void
+slot_read (const task_slot_t * p_slot, i2cprof_task_stats_t * p_stats)
+{
+    uint32_t seq = 0;
+    uint32_t gen = 0;
+
+    do
+    {
+        seq = __atomic_load_n(&p_slot->seq, __ATOMIC_ACQUIRE);
+        gen = p_slot->gen;
+        *p_stats = p_slot->stats;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    }
+    while ((seq & 1) || (seq != __atomic_load_n(&p_slot->seq, __ATOMIC_RELAXED)));
+
+    // Nessun aggiornamento nel periodo corrente: le stats sono del precedente
+    //
+    if (gen != __atomic_load_n(&g_gen, __ATOMIC_RELAXED))
+    {
+        memset(p_stats, 0, sizeof(*p_stats));
+    }
+}
+
+static void
+atomic_max (uint32_t * p_max, uint32_t value)
+{
+    uint32_t old = __atomic_load_n(p_max, __ATOMIC_RELAXED);
+
+    while ((value > old) &&
+           !__atomic_compare_exchange_n(p_max, &old, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+static void
+account_xfer (uint8_t addr, size_t bytes, int64_t usecs, esp_err_t ret)
+{
+    task_slot_t * p_slot = task_slot();
+    i2cprof_addr_stats_t * p_addr = &g_addrs[addr & (N_ADDR - 1)];
+
+    __atomic_fetch_add(&p_addr->n_xfer, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p_addr->n_bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p_addr->bus_us, (uint32_t) usecs, __ATOMIC_RELAXED);
+    atomic_max(&p_addr->bus_max_us, (uint32_t) usecs);
+
+    if (ret != ESP_OK)
+    {
+        __atomic_fetch_add(&p_addr->n_error, 1, __ATOMIC_RELAXED);
+    }
+
+    if (p_slot != NULL)
+    {
+        slot_begin(p_slot);
+        p_slot->stats.n_xfer++;
+        p_slot->stats.n_bytes += bytes;
+
+        if (ret != ESP_OK)
+        {
+            p_slot->stats.n_error++;
+        }
+
+        slot_end(p_slot);
+    }
+}
+
+BaseType_t
+i2cprof_lock (SemaphoreHandle_t h_mutex, TickType_t ticks)
+{
+    task_slot_t * p_slot = task_slot();
+    int64_t t0 = esp_timer_get_time();
+    uint32_t wait = 0;
+    BaseType_t ret = 0;
+
+    ret = xSemaphoreTake(h_mutex, ticks);
+
+    if ((p_slot != NULL) && (pdPASS == ret))
+    {
+        p_slot->t_locked = esp_timer_get_time();
+        wait = (uint32_t) (p_slot->t_locked - t0);
+        slot_begin(p_slot);
+        p_slot->stats.n_lock++;
+        p_slot->stats.wait_us += wait;
+
+        if (wait > p_slot->stats.wait_max_us)
+        {
+            p_slot->stats.wait_max_us = wait;
+        }
+
+        slot_end(p_slot);
+    }
+
+    return ret;
+}
+
+BaseType_t
+i2cprof_unlock (SemaphoreHandle_t h_mutex)
+{
+    task_slot_t * p_slot = task_slot();
+    uint32_t hold = 0;
+
+    if ((p_slot != NULL) && (p_slot->t_locked != 0))
+    {
+        hold = (uint32_t) (esp_timer_get_time() - p_slot->t_locked);
+        p_slot->t_locked = 0;
+        slot_begin(p_slot);
+        p_slot->stats.hold_us += hold;
+
+        if (hold > p_slot->stats.hold_max_us)
+        {
+            p_slot->stats.hold_max_us = hold;
+        }
+
+        slot_end(p_slot);
+    }
+
+    return xSemaphoreGive(h_mutex);
+}
+
+esp_err_t
+i2cprof_cmd_begin (i2c_port_t port, uint8_t addr, size_t bytes, i2c_cmd_handle_t h_cmd, TickType_t ticks)
+{
+    int64_t usecs = esp_timer_get_time();
+    esp_err_t ret = ESP_OK;
+
+    ret = i2c_master_cmd_begin(port, h_cmd, ticks);
+    account_xfer(addr, bytes, esp_timer_get_time() - usecs, ret);
+
+    return ret;
+}
+
+esp_err_t
+i2cprof_write_to_device (i2c_port_t port, uint8_t addr, const uint8_t * p_data, size_t len, TickType_t ticks)
+{
+    int64_t usecs = esp_timer_get_time();
+    esp_err_t ret = ESP_OK;
+
+    ret = i2c_master_write_to_device(port, addr, p_data, len, ticks);
+    account_xfer(addr, len, esp_timer_get_time() - usecs, ret);
+
+    return ret;
+}
+
+static void
+addr_read (uint32_t addr, i2cprof_addr_stats_t * p_stats)
+{
+    const i2cprof_addr_stats_t * p_addr = &g_addrs[addr];
+
+    p_stats->n_xfer = __atomic_load_n(&p_addr->n_xfer, __ATOMIC_RELAXED);
+    p_stats->n_error = __atomic_load_n(&p_addr->n_error, __ATOMIC_RELAXED);
+    p_stats->n_bytes = __atomic_load_n(&p_addr->n_bytes, __ATOMIC_RELAXED);
+    p_stats->bus_us = __atomic_load_n(&p_addr->bus_us, __ATOMIC_RELAXED);
+    p_stats->bus_max_us = __atomic_load_n(&p_addr->bus_max_us, __ATOMIC_RELAXED);
+}
+
+void
+i2cprof_export (FILE * p_out)
+{
+    uint32_t order[I2CPROF_MAX_TASKS] = {0};
+    uint32_t n_tasks = 0;
+
+    // Task ordinati per nome: l'output e' confrontabile con diff fra build
+    // diverse anche se l'ordine di registrazione cambia.
+    //
+    for (uint32_t idx = 0; idx < __atomic_load_n(&g_n_tasks, __ATOMIC_RELAXED); ++idx)
+    {
+        uint32_t pos = n_tasks;
+
+        if (!__atomic_load_n(&g_tasks[idx].b_ready, __ATOMIC_ACQUIRE))
+        {
+            continue;
+        }
+
+        while ((pos > 0) && (strcmp(g_tasks[order[pos - 1]].name, g_tasks[idx].name) > 0))
+        {
+            order[pos] = order[pos - 1];
+            --pos;
+        }
+
+        order[pos] = idx;
+        ++n_tasks;
+    }
+
+    fprintf(p_out, "# i2cprof v1 period_ms=%u\n", g_period_ms);
+
+    for (uint32_t idx = 0; idx < n_tasks; ++idx)
+    {
+        const task_slot_t * p_slot = &g_tasks[order[idx]];
+        i2cprof_task_stats_t stats = {0};
+
+        slot_read(p_slot, &stats);
+
+        fprintf(p_out, "task %-16s locks=%u xfer=%u bytes=%u err=%u "
+                "wait_us=%llu wait_avg_us=%llu wait_max_us=%u "
+                "hold_us=%llu hold_avg_us=%llu hold_max_us=%u\n",
+                p_slot->name, stats.n_lock, stats.n_xfer, stats.n_bytes, stats.n_error,
+                stats.wait_us, stats.n_lock ? stats.wait_us / stats.n_lock : 0, stats.wait_max_us,
+                stats.hold_us, stats.n_lock ? stats.hold_us / stats.n_lock : 0, stats.hold_max_us);
+    }
+
+    for (uint32_t addr = 0; addr < N_ADDR; ++addr)
+    {
+        const i2cprof_addr_stats_t * p_base = &g_addrs_base[addr];
+        i2cprof_addr_stats_t stats = {0};
+
+        addr_read(addr, &stats);
+        stats.n_xfer -= p_base->n_xfer;
+        stats.n_error -= p_base->n_error;
+        stats.n_bytes -= p_base->n_bytes;
+        stats.bus_us -= p_base->bus_us;
+
+        if (0 == stats.n_xfer)
+        {
+            continue;
+        }
+
+        fprintf(p_out, "addr 0x%02X xfer=%u bytes=%u err=%u bus_us=%u bus_avg_us=%u bus_max_us=%u\n",
+                addr, stats.n_xfer, stats.n_bytes, stats.n_error,
+                stats.bus_us, stats.bus_us / stats.n_xfer, stats.bus_max_us);
+    }
+}
+
+void
+i2cprof_reset (void)
+{
+    // Nessuna scrittura sugli slot dei task: il nuovo periodo parte quando
+    // ciascun proprietario osserva la generazione successiva.
+    //
+    __atomic_fetch_add(&g_gen, 1, __ATOMIC_RELAXED);
+
+    for (uint32_t addr = 0; addr < N_ADDR; ++addr)
+    {
+        addr_read(addr, &g_addrs_base[addr]);
+        (void) __atomic_exchange_n(&g_addrs[addr].bus_max_us, 0, __ATOMIC_RELAXED);
+    }
+}
+
+static void
+task_report (void * p_arg)
+{
+    TickType_t ticktime = xTaskGetTickCount();
+
+    for (;;)
+    {
+        vTaskDelayUntil(&ticktime, pdMS_TO_TICKS(g_period_ms));
+        i2cprof_export(stdout);
+        i2cprof_reset();
+    }
+}
+
+void
+i2cprof_start_report (uint32_t period_ms, UBaseType_t prio, BaseType_t cpu)
+{
+    BaseType_t ret = 0;
+
+    g_period_ms = period_ms;
+
+    ret = xTaskCreatePinnedToCore(task_report, "i2cprof", 3072, NULL, prio, NULL, cpu);
+    assert(pdPASS == ret);
+}
+
+#endif /* I2CPROF_ENABLE */
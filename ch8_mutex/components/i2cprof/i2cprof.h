@@ -0,0 +1,73 @@
+#ifndef I2CPROF_H
+#define I2CPROF_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <driver/i2c.h>
+#include <esp_err.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Con I2CPROF_ENABLE a 0 i wrapper si riducono alle chiamate originali
+#ifndef I2CPROF_ENABLE
+#   define I2CPROF_ENABLE      1
+#endif /* I2CPROF_ENABLE */
+
+#define I2CPROF_MAX_TASKS   8
+#define I2CPROF_TLS_INDEX   1       // Slot TLS usato per le statistiche del task (0 e' di pthread)
+
+typedef struct
+{
+    uint32_t n_lock;
+    uint32_t n_xfer;
+    uint32_t n_error;
+    uint32_t n_bytes;
+    uint64_t wait_us;       // Attesa per acquisire il bus
+    uint64_t hold_us;       // Bus trattenuto (mutex preso)
+    uint32_t wait_max_us;
+    uint32_t hold_max_us;
+} i2cprof_task_stats_t;
+
+typedef struct
+{
+    uint32_t n_xfer;
+    uint32_t n_error;
+    uint32_t n_bytes;
+    uint32_t bus_us;        // Durata di i2c_master_cmd_begin()
+    uint32_t bus_max_us;
+} i2cprof_addr_stats_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#if I2CPROF_ENABLE
+
+BaseType_t i2cprof_lock(SemaphoreHandle_t h_mutex, TickType_t ticks);
+BaseType_t i2cprof_unlock(SemaphoreHandle_t h_mutex);
+esp_err_t i2cprof_cmd_begin(i2c_port_t port, uint8_t addr, size_t bytes, i2c_cmd_handle_t h_cmd, TickType_t ticks);
+esp_err_t i2cprof_write_to_device(i2c_port_t port, uint8_t addr, const uint8_t * p_data, size_t len, TickType_t ticks);
+void i2cprof_export(FILE * p_out);
+void i2cprof_reset(void);
+void i2cprof_start_report(uint32_t period_ms, UBaseType_t prio, BaseType_t cpu);
+
+#else
+
+#define i2cprof_lock(h_mutex, ticks)        xSemaphoreTake((h_mutex), (ticks))
+#define i2cprof_unlock(h_mutex)             xSemaphoreGive(h_mutex)
+#define i2cprof_cmd_begin(port, addr, bytes, h_cmd, ticks) \
+    i2c_master_cmd_begin((port), (h_cmd), (ticks))
+#define i2cprof_write_to_device(port, addr, p_data, len, ticks) \
+    i2c_master_write_to_device((port), (addr), (p_data), (len), (ticks))
+#define i2cprof_export(p_out)               do {} while (0)
+#define i2cprof_reset()                     do {} while (0)
+#define i2cprof_start_report(period_ms, prio, cpu)  do {} while (0)
+
+#endif /* I2CPROF_ENABLE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* I2CPROF_H */
@@ -6,6 +6,7 @@
 #include <esp_err.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "../components/i2cprof/i2cprof.h"
 
 #define GPIO_I2C_SDA    21
 #define GPIO_I2C_SCL    22
@@ -19,6 +20,8 @@
 #   define DEV1 0x21
 #endif /* PCF8574A */
 
+#define REPORT_MS       10000
+
 static int32_t g_app_cpu = 0;
 static SemaphoreHandle_t gh_mutex = NULL;
 static int32_t g_pcf8574_1 = DEV0;
@@ -29,7 +32,7 @@ lock_i2c (void)
 {
     BaseType_t ret = 0;
 
-    ret = xSemaphoreTake(gh_mutex, portMAX_DELAY);
+    ret = i2cprof_lock(gh_mutex, portMAX_DELAY);
     assert(pdPASS == ret);
 }
 
@@ -38,7 +41,7 @@ unlock_i2c (void)
 {
     BaseType_t ret = 0;
 
-    ret = xSemaphoreGive(gh_mutex);
+    ret = i2cprof_unlock(gh_mutex);
     assert(pdPASS == ret);
 }
 
@@ -52,7 +55,7 @@ task_led (void * p_arg)
 
     lock_i2c();
 
-    ret = i2c_master_write_to_device(I2C_NUM_0, i2c_addr, buffer, sizeof(buffer), 1000 / portTICK_RATE_MS);
+    ret = i2cprof_write_to_device(I2C_NUM_0, i2c_addr, buffer, sizeof(buffer), 1000 / portTICK_RATE_MS);
 
     if (ESP_OK == ret)
     {
@@ -76,7 +79,7 @@ task_led (void * p_arg)
         b_led_status ^= true;
         printf("LED 0x%02X %s\n", i2c_addr, b_led_status ? "on" : "off");
         buffer[0] = true == b_led_status ? 0xF7 : 0xFF;
-        ret = i2c_master_write_to_device(I2C_NUM_0, i2c_addr, buffer, sizeof(buffer), 1000 / portTICK_RATE_MS);
+        ret = i2cprof_write_to_device(I2C_NUM_0, i2c_addr, buffer, sizeof(buffer), 1000 / portTICK_RATE_MS);
         unlock_i2c();
         vTaskDelay(pdMS_TO_TICKS(i2c_addr & 1 ? 500 : 1000));
     }
@@ -104,6 +107,8 @@ app_main (void)
     gh_mutex = xSemaphoreCreateMutex();
     assert(gh_mutex != NULL);
 
+    i2cprof_start_report(REPORT_MS, 1, g_app_cpu);
+
     vTaskDelay(2000);
 
     ret = xTaskCreatePinnedToCore(task_led, "led task 1", 2048, &g_pcf8574_1, 1, NULL, g_app_cpu);
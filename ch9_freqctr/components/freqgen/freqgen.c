@@ -0,0 +1,126 @@
+#include <driver/ledc.h>
+#include <esp_timer.h>
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "freqgen.h"
+
+#define APB_CLK_HZ      80000000
+#define REF_CLK_HZ      1000000
+
+// Divisore del timer LEDC: 10 bit interi e 8 frazionari, minimo 1
+#define DIV_MAX         1024
+
+static void
+clk_range (freqgen_t * p_gen, ledc_clk_cfg_t clk)
+{
+    uint32_t src_hz = (LEDC_USE_APB_CLK == clk) ? APB_CLK_HZ : REF_CLK_HZ;
+
+    p_gen->clk = clk;
+    p_gen->max_hz = src_hz >> p_gen->cfg.resolution;
+    p_gen->min_hz = p_gen->max_hz / DIV_MAX + 1;
+}
+
+static esp_err_t
+reconfig (freqgen_t * p_gen, uint32_t hz)
+{
+    esp_err_t ret = ESP_OK;
+    ledc_timer_config_t timer_cfg = {
+        .speed_mode       = p_gen->cfg.speed_mode,
+        .timer_num        = p_gen->cfg.timer,
+        .duty_resolution  = p_gen->cfg.resolution,
+        .freq_hz          = hz,
+    };
+    ledc_channel_config_t channel_cfg = {
+        .speed_mode     = p_gen->cfg.speed_mode,
+        .channel        = p_gen->cfg.channel,
+        .timer_sel      = p_gen->cfg.timer,
+        .intr_type      = LEDC_INTR_DISABLE,
+        .gpio_num       = p_gen->cfg.gpio,
+        .hpoint         = 0,
+        .duty           = p_gen->cfg.duty
+    };
+
+    // Sorgente esplicita, non LEDC_AUTO_CLK: il campo del divisore deve
+    // essere noto per decidere quando basta ledc_set_freq()
+    //
+    clk_range(p_gen, LEDC_USE_APB_CLK);
+
+    if (hz < p_gen->min_hz)
+    {
+        clk_range(p_gen, LEDC_USE_REF_TICK);
+    }
+
+    timer_cfg.clk_cfg = p_gen->clk;
+    ret = ledc_timer_config(&timer_cfg);
+
+    if ((ESP_OK == ret) && !p_gen->b_running)
+    {
+        ret = ledc_channel_config(&channel_cfg);
+    }
+
+    p_gen->b_running = (ESP_OK == ret);
+
+    return ret;
+}
+
+esp_err_t
+freqgen_init (freqgen_t * p_gen, const freqgen_config_t * p_cfg)
+{
+    memset(p_gen, 0, sizeof(*p_gen));
+    p_gen->cfg = *p_cfg;
+
+    return ESP_OK;
+}
+
+esp_err_t
+freqgen_set (freqgen_t * p_gen, uint32_t hz)
+{
+    esp_err_t ret = ESP_OK;
+    int64_t usecs = 0;
+
+    if (0 == hz)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (p_gen->b_running && (hz == p_gen->hz))
+    {
+        p_gen->n_skip++;
+        return ESP_OK;
+    }
+
+    usecs = esp_timer_get_time();
+
+    // Nello stesso campo cambia solo il divisore, applicato dall'hardware a
+    // fine periodo: l'uscita non si interrompe
+    //
+    if (p_gen->b_running && (hz >= p_gen->min_hz) && (hz <= p_gen->max_hz)
+        && (ESP_OK == ledc_set_freq(p_gen->cfg.speed_mode, p_gen->cfg.timer, hz)))
+    {
+        p_gen->n_fast++;
+    }
+    else
+    {
+        ret = reconfig(p_gen, hz);
+        p_gen->n_full++;
+    }
+
+    p_gen->last_us = esp_timer_get_time() - usecs;
+
+    if (ESP_OK == ret)
+    {
+        p_gen->hz = hz;
+    }
+
+    return ret;
+}
+
+esp_err_t
+freqgen_stop (freqgen_t * p_gen)
+{
+    p_gen->b_running = false;
+
+    return ledc_stop(p_gen->cfg.speed_mode, p_gen->cfg.channel, 0);
+}
@@ -0,0 +1,49 @@
+#ifndef FREQGEN_H
+#define FREQGEN_H
+
+#include <driver/ledc.h>
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+    ledc_mode_t speed_mode;
+    ledc_timer_t timer;
+    ledc_channel_t channel;
+    int gpio;
+    ledc_timer_bit_t resolution;
+    uint32_t duty;
+} freqgen_config_t;
+
+// Configurazione LEDC attiva: finche' la frequenza resta nel campo del
+// divisore della sorgente di clock corrente basta ledc_set_freq()
+//
+typedef struct
+{
+    freqgen_config_t cfg;
+    bool b_running;
+    ledc_clk_cfg_t clk;
+    uint32_t hz;
+    uint32_t min_hz;        // Campo del divisore con la sorgente corrente
+    uint32_t max_hz;
+    uint32_t n_skip;        // Frequenza invariata
+    uint32_t n_fast;        // Solo divisore aggiornato
+    uint32_t n_full;        // Timer e canale riconfigurati
+    uint32_t last_us;       // Durata dell'ultima modifica
+} freqgen_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+esp_err_t freqgen_init(freqgen_t * p_gen, const freqgen_config_t * p_cfg);
+esp_err_t freqgen_set(freqgen_t * p_gen, uint32_t hz);
+esp_err_t freqgen_stop(freqgen_t * p_gen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREQGEN_H */
@@ -0,0 +1,301 @@
+#include <freertos/FreeRTOS.h>
+#include <driver/pcnt.h>
+#include <soc/pcnt_struct.h>
+#include <esp_timer.h>
+#include <esp_err.h>
+#include <esp_bit_defs.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "freqmeter.h"
+
+typedef struct
+{
+    uint32_t count;         // Conteggio esteso a 32 bit
+    uint32_t usecs;
+} sample_t;
+
+typedef struct
+{
+    freqmeter_config_t cfg;
+    uint32_t step;
+    uint32_t count;
+    int16_t last_cnt;
+    uint32_t last_us;
+    sample_t ring[FREQMETER_AVG_MAX + 1];
+    uint32_t head;
+    uint32_t n_ring;
+    uint32_t seq;           // Dispari durante la scrittura di result
+    freqmeter_result_t result;
+} channel_t;
+
+static channel_t g_chan[PCNT_UNIT_MAX] = {0};
+static uint32_t g_enabled = 0;      // Bit per unita' PCNT attiva
+static uint32_t g_isr_count = 0;
+static portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+static pcnt_isr_handle_t gh_isr = NULL;
+static esp_timer_handle_t gh_watchdog = NULL;
+
+// Slot "ultimo valore" senza lock: un solo scrittore (ISR o watchdog, sotto
+// g_mux), i lettori ripetono se la sequenza cambia durante la copia
+//
+static void
+publish (channel_t * p_chan, uint32_t hz, uint32_t usecs)
+{
+    __atomic_store_n(&p_chan->seq, p_chan->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    p_chan->result.hz = hz;
+    p_chan->result.usecs = usecs;
+    p_chan->result.step = p_chan->step;
+    __atomic_store_n(&p_chan->seq, p_chan->seq + 1, __ATOMIC_RELEASE);
+}
+
+// Legge conteggio e istante insieme, estende il conteggio a 32 bit e fissa
+// la prossima soglia step impulsi piu' avanti
+//
+static void
+sample (pcnt_unit_t unit, channel_t * p_chan, sample_t * p_sample, bool b_from_isr)
+{
+    uint32_t usecs = esp_timer_get_time();
+    int16_t cnt = PCNT.cnt_unit[unit].cnt_val;
+    uint32_t thres = 0;
+
+    // Almeno un interrupt (H_LIM) per giro: il conteggio resta monotono
+    //
+    p_chan->count += (cnt >= p_chan->last_cnt) ? cnt - p_chan->last_cnt : cnt + FREQMETER_COUNT_LIM - p_chan->last_cnt;
+    p_chan->last_cnt = cnt;
+
+    // Campioni troppo ravvicinati (segnale tornato dopo un timeout): il passo
+    // raddoppia subito, senza attendere la stima
+    //
+    if (b_from_isr && ((usecs - p_chan->last_us) < p_chan->cfg.gate_ms * 250)
+        && (p_chan->step < FREQMETER_COUNT_LIM / 2))
+    {
+        p_chan->step *= 2;
+    }
+
+    p_chan->last_us = usecs;
+
+    thres = cnt + p_chan->step;
+    thres = (thres > FREQMETER_COUNT_LIM - 1) ? FREQMETER_COUNT_LIM - 1 : thres;
+
+    // Scrittura diretta del registro: il driver prende il proprio spinlock e
+    // non e' in IRAM, mentre qui si e' gia' dentro g_mux
+    //
+    PCNT.conf_unit[unit].conf1.cnt_thres0 = thres;
+
+    p_sample->count = p_chan->count;
+    p_sample->usecs = usecs;
+}
+
+static void
+update (channel_t * p_chan, const sample_t * p_sample)
+{
+    uint32_t size = p_chan->cfg.avg_n + 1;
+    const sample_t * p_old = NULL;
+    uint64_t hz = 0;
+    uint64_t step = 0;
+
+    p_chan->ring[p_chan->head] = *p_sample;
+    p_chan->head = (p_chan->head + 1) % size;
+    p_chan->n_ring += (p_chan->n_ring < size) ? 1 : 0;
+    p_old = &p_chan->ring[(p_chan->head + size - p_chan->n_ring) % size];
+
+    if ((p_chan->n_ring < 2) || (p_sample->usecs == p_old->usecs))
+    {
+        return;
+    }
+
+    // Frequenza reciproca sugli ultimi avg_n intervalli
+    //
+    hz = (uint64_t) (p_sample->count - p_old->count) * 1000000 / (uint32_t) (p_sample->usecs - p_old->usecs);
+    step = hz * p_chan->cfg.gate_ms / 1000;
+    p_chan->step = (step < 1) ? 1 : (step > FREQMETER_COUNT_LIM - 1) ? FREQMETER_COUNT_LIM - 1 : step;
+
+    publish(p_chan, (uint32_t) hz, p_sample->usecs);
+}
+
+// ISR unica per tutte le unita': un solo passaggio su int_st. Accede solo
+// ai registri PCNT, senza chiamare il driver.
+//
+static void
+isr_pcnt (void * p_arg)
+{
+    uint32_t status = PCNT.int_st.val & g_enabled;
+    sample_t smp = {0};
+
+    PCNT.int_clr.val = status;
+    g_isr_count++;
+
+    portENTER_CRITICAL_ISR(&g_mux);
+
+    while (status != 0)
+    {
+        pcnt_unit_t unit = __builtin_ctz(status);
+
+        status &= status - 1;
+        sample(unit, &g_chan[unit], &smp, true);
+        update(&g_chan[unit], &smp);
+    }
+
+    portEXIT_CRITICAL_ISR(&g_mux);
+}
+
+// Senza impulsi non arrivano interrupt: il watchdog azzera le unita' ferme
+// e riarma la soglia al prossimo fronte
+//
+static void
+watchdog (void * p_arg)
+{
+    uint32_t now = esp_timer_get_time();
+    sample_t smp = {0};
+
+    portENTER_CRITICAL(&g_mux);
+
+    for (uint32_t unit = 0; unit < PCNT_UNIT_MAX; ++unit)
+    {
+        channel_t * p_chan = &g_chan[unit];
+
+        if ((g_enabled & BIT(unit)) && ((now - p_chan->last_us) > FREQMETER_NOSIGNAL_MS * 1000))
+        {
+            p_chan->n_ring = 0;
+            p_chan->step = 1;
+            sample(unit, p_chan, &smp, false);
+            publish(p_chan, 0, now);
+        }
+    }
+
+    portEXIT_CRITICAL(&g_mux);
+}
+
+esp_err_t
+freqmeter_init (void)
+{
+    esp_err_t ret = ESP_OK;
+    esp_timer_create_args_t args = {
+        .callback = watchdog,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "freqmeter",
+    };
+
+    if (gh_isr != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Non compatibile con pcnt_isr_service_install(): l'ISR e' unica
+    //
+    ret = pcnt_isr_register(isr_pcnt, NULL, 0, &gh_isr);
+
+    if (ESP_OK == ret)
+    {
+        ret = esp_timer_create(&args, &gh_watchdog);
+    }
+
+    if (ESP_OK == ret)
+    {
+        ret = esp_timer_start_periodic(gh_watchdog, FREQMETER_NOSIGNAL_MS * 1000 / 2);
+    }
+
+    return ret;
+}
+
+esp_err_t
+freqmeter_add (pcnt_unit_t unit, const freqmeter_config_t * p_cfg)
+{
+    pcnt_config_t cfg = {0};
+    channel_t * p_chan = NULL;
+    esp_err_t ret = ESP_OK;
+
+    if ((unit >= PCNT_UNIT_MAX) || (0 == p_cfg->gate_ms) || (0 == p_cfg->avg_n)
+        || (p_cfg->avg_n > FREQMETER_AVG_MAX) || (NULL == gh_isr))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    p_chan = &g_chan[unit];
+    memset(p_chan, 0, sizeof(*p_chan));
+    p_chan->cfg = *p_cfg;
+    p_chan->step = 1;
+    p_chan->last_us = esp_timer_get_time();
+
+    cfg.pulse_gpio_num = p_cfg->gpio;
+    cfg.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+    cfg.channel = PCNT_CHANNEL_0;
+    cfg.unit = unit;
+    cfg.pos_mode = PCNT_COUNT_INC;
+    cfg.neg_mode = PCNT_COUNT_DIS;
+    cfg.lctrl_mode = PCNT_MODE_KEEP;
+    cfg.hctrl_mode = PCNT_MODE_KEEP;
+    cfg.counter_h_lim = FREQMETER_COUNT_LIM;
+    cfg.counter_l_lim = 0;
+
+    ret = pcnt_unit_config(&cfg);
+
+    if (ESP_OK == ret)
+    {
+        ret = pcnt_set_event_value(unit, PCNT_EVT_THRES_0, p_chan->step);
+    }
+
+    if (ESP_OK == ret)
+    {
+        ret = pcnt_event_enable(unit, PCNT_EVT_THRES_0);
+    }
+
+    if (ESP_OK == ret)
+    {
+        ret = pcnt_event_enable(unit, PCNT_EVT_H_LIM);
+    }
+
+    if (ESP_OK == ret)
+    {
+        ret = pcnt_counter_clear(unit);
+    }
+
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    portENTER_CRITICAL(&g_mux);
+    g_enabled |= BIT(unit);
+    portEXIT_CRITICAL(&g_mux);
+
+    ret = pcnt_intr_enable(unit);
+
+    if (ESP_OK == ret)
+    {
+        ret = pcnt_counter_resume(unit);
+    }
+
+    if (ret != ESP_OK)
+    {
+        portENTER_CRITICAL(&g_mux);
+        g_enabled &= ~BIT(unit);
+        portEXIT_CRITICAL(&g_mux);
+    }
+
+    return ret;
+}
+
+bool
+freqmeter_get (pcnt_unit_t unit, freqmeter_result_t * p_result)
+{
+    channel_t * p_chan = &g_chan[unit];
+    uint32_t seq = 0;
+
+    do
+    {
+        seq = __atomic_load_n(&p_chan->seq, __ATOMIC_ACQUIRE);
+        *p_result = p_chan->result;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || (seq != __atomic_load_n(&p_chan->seq, __ATOMIC_RELAXED)));
+
+    return (p_result->hz != 0);
+}
+
+uint32_t
+freqmeter_isr_count (void)
+{
+    return g_isr_count;
+}
@@ -0,0 +1,41 @@
+#ifndef FREQMETER_H
+#define FREQMETER_H
+
+#include <driver/pcnt.h>
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FREQMETER_COUNT_LIM     30000   // Il PCNT riparte da 0 a questo valore
+#define FREQMETER_AVG_MAX       16      // Intervalli massimi nella media mobile
+#define FREQMETER_NOSIGNAL_MS   500
+
+typedef struct
+{
+    int gpio;
+    uint32_t gate_ms;       // Intervallo desiderato fra due campioni
+    uint32_t avg_n;         // Intervalli nella media mobile, 1..FREQMETER_AVG_MAX
+} freqmeter_config_t;
+
+typedef struct
+{
+    uint32_t hz;            // Media mobile reciproca
+    uint32_t usecs;         // Istante dell'ultimo campione
+    uint32_t step;          // Impulsi fra due interrupt (gate adattivo)
+} freqmeter_result_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+esp_err_t freqmeter_init(void);
+esp_err_t freqmeter_add(pcnt_unit_t unit, const freqmeter_config_t * p_cfg);
+bool freqmeter_get(pcnt_unit_t unit, freqmeter_result_t * p_result);
+uint32_t freqmeter_isr_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREQMETER_H */
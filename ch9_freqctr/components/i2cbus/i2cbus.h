@@ -0,0 +1,70 @@
+#ifndef I2CBUS_H
+#define I2CBUS_H
+
+#include <freertos/FreeRTOS.h>
+#include <driver/i2c.h>
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define I2CBUS_MAX_CLIENTS  8
+#define I2CBUS_BATCH_BYTES  32      // Byte massimi accorpati in una transazione
+#define I2CBUS_BATCH_XFERS  8       // Richieste massime accorpate in una transazione
+
+// Bit di notifica riservato al completamento: i task client possono usare gli
+// altri bit del proprio valore di notifica, non eSetValueWithOverwrite.
+//
+#define I2CBUS_NFY_DONE     (1UL << 31)
+
+// Transazione accorpabile con le scritture successive allo stesso indirizzo
+#define I2CBUS_F_BATCH      (1 << 0)
+
+typedef enum
+{
+    I2CBUS_PRIO_HIGH = 0,   // Scritture brevi (es. port expander)
+    I2CBUS_PRIO_NORMAL,
+    I2CBUS_PRIO_LOW,        // Trasferimenti lunghi (es. pagine OLED)
+    I2CBUS_N_PRIO
+} i2cbus_prio_t;
+
+typedef struct
+{
+    i2c_port_t port;
+    int32_t gpio_sda;
+    int32_t gpio_scl;
+    bool b_pullup;
+    uint32_t clk_speed;
+    UBaseType_t task_prio;
+    BaseType_t task_cpu;
+    UBaseType_t q_depth;    // Profondita' di ciascuna coda di priorita'
+} i2cbus_config_t;
+
+typedef struct
+{
+    uint64_t bus_us;        // Tempo di bus attribuito al client
+    uint32_t n_xfer;        // Transazioni completate
+    uint32_t n_batched;     // Transazioni accorpate in una precedente
+    uint32_t n_error;
+    uint32_t n_bytes;
+} i2cbus_stats_t;
+
+typedef int32_t i2cbus_client_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+esp_err_t i2cbus_init(const i2cbus_config_t * p_cfg);
+i2cbus_client_t i2cbus_client_add(const char * p_name, i2cbus_prio_t prio);
+esp_err_t i2cbus_write(i2cbus_client_t client, uint8_t addr, const uint8_t * p_data, size_t len, uint32_t flags);
+esp_err_t i2cbus_read(i2cbus_client_t client, uint8_t addr, uint8_t * p_data, size_t len);
+esp_err_t i2cbus_write_read(i2cbus_client_t client, uint8_t addr, const uint8_t * p_wr, size_t wr_len, uint8_t * p_rd, size_t rd_len);
+void i2cbus_get_stats(i2cbus_client_t client, i2cbus_stats_t * p_stats);
+void i2cbus_print_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* I2CBUS_H */
@@ -7,6 +7,7 @@
 #include "esp_log.h"
 
 #include "ssd1306.h"
+#include "i2cbus.h"
 
 #define tag "SSD1306"
 
@@ -15,18 +16,27 @@
 
 #define I2C_MASTER_FREQ_HZ 400000 /*!< I2C clock of SSD1306 can run at 400 kHz max. */
 
+// Il bus e' servito dal task di i2cbus: il display e' un client a bassa
+// priorita' e ogni pagina e' una transazione separata.
+#define I2C_BUS_PRIO 2
+
+static i2cbus_client_t i2c_client = -1;
+
 void i2c_master_init(SSD1306_t * dev, int16_t sda, int16_t scl, int16_t reset)
 {
-	i2c_config_t i2c_config = {
-		.mode = I2C_MODE_MASTER,
-		.sda_io_num = sda,
-		.scl_io_num = scl,
-		.sda_pullup_en = GPIO_PULLUP_ENABLE,
-		.scl_pullup_en = GPIO_PULLUP_ENABLE,
-		.master.clk_speed = I2C_MASTER_FREQ_HZ
+	i2cbus_config_t i2c_config = {
+		.port = I2C_NUM,
+		.gpio_sda = sda,
+		.gpio_scl = scl,
+		.b_pullup = true,
+		.clk_speed = I2C_MASTER_FREQ_HZ,
+		.task_prio = I2C_BUS_PRIO,
+		.task_cpu = xPortGetCoreID(),
+		.q_depth = 4
 	};
-	ESP_ERROR_CHECK(i2c_param_config(I2C_NUM, &i2c_config));
-	ESP_ERROR_CHECK(i2c_driver_install(I2C_NUM, I2C_MODE_MASTER, 0, 0, 0));
+	ESP_ERROR_CHECK(i2cbus_init(&i2c_config));
+	i2c_client = i2cbus_client_add("ssd1306", I2CBUS_PRIO_LOW);
+	assert(i2c_client >= 0);
 
 	if (reset >= 0) {
 		//gpio_pad_select_gpio(reset);
@@ -46,66 +56,65 @@ void i2c_init(SSD1306_t * dev, int width, int height) {
 	dev->_pages = 8;
 	if (dev->_height == 32) dev->_pages = 4;
 	
-	i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-
-	i2c_master_start(cmd);
-	i2c_master_write_byte(cmd, (dev->_address << 1) | I2C_MASTER_WRITE, true);
-	i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_CMD_STREAM, true);
-	i2c_master_write_byte(cmd, OLED_CMD_DISPLAY_OFF, true);				// AE
-	i2c_master_write_byte(cmd, OLED_CMD_SET_MUX_RATIO, true);			// A8
-	if (dev->_height == 64) i2c_master_write_byte(cmd, 0x3F, true);
-	if (dev->_height == 32) i2c_master_write_byte(cmd, 0x1F, true);
-	i2c_master_write_byte(cmd, OLED_CMD_SET_DISPLAY_OFFSET, true);		// D3
-	i2c_master_write_byte(cmd, 0x00, true);
-	//i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_DATA_STREAM, true);	// 40
-	i2c_master_write_byte(cmd, OLED_CMD_SET_DISPLAY_START_LINE, true);	// 40
-	//i2c_master_write_byte(cmd, OLED_CMD_SET_SEGMENT_REMAP, true);		// A1
+	uint8_t cmd[32];
+	int n = 0;
+
+	cmd[n++] = OLED_CONTROL_BYTE_CMD_STREAM;
+	cmd[n++] = OLED_CMD_DISPLAY_OFF;				// AE
+	cmd[n++] = OLED_CMD_SET_MUX_RATIO;			// A8
+	if (dev->_height == 64) cmd[n++] = 0x3F;
+	if (dev->_height == 32) cmd[n++] = 0x1F;
+	cmd[n++] = OLED_CMD_SET_DISPLAY_OFFSET;		// D3
+	cmd[n++] = 0x00;
+	//cmd[n++] = OLED_CONTROL_BYTE_DATA_STREAM;	// 40
+	cmd[n++] = OLED_CMD_SET_DISPLAY_START_LINE;	// 40
+	//cmd[n++] = OLED_CMD_SET_SEGMENT_REMAP;		// A1
 	if (dev->_flip) {
-		i2c_master_write_byte(cmd, OLED_CMD_SET_SEGMENT_REMAP_0, true);		// A0
+		cmd[n++] = OLED_CMD_SET_SEGMENT_REMAP_0;		// A0
 	} else {
-		i2c_master_write_byte(cmd, OLED_CMD_SET_SEGMENT_REMAP_1, true);		// A1
+		cmd[n++] = OLED_CMD_SET_SEGMENT_REMAP_1;		// A1
 	}
-	i2c_master_write_byte(cmd, OLED_CMD_SET_COM_SCAN_MODE, true);		// C8
-	i2c_master_write_byte(cmd, OLED_CMD_SET_DISPLAY_CLK_DIV, true);		// D5
-	i2c_master_write_byte(cmd, 0x80, true);
-	i2c_master_write_byte(cmd, OLED_CMD_SET_COM_PIN_MAP, true);			// DA
-	if (dev->_height == 64) i2c_master_write_byte(cmd, 0x12, true);
-	if (dev->_height == 32) i2c_master_write_byte(cmd, 0x02, true);
-	i2c_master_write_byte(cmd, OLED_CMD_SET_CONTRAST, true);			// 81
-	i2c_master_write_byte(cmd, 0xFF, true);
-	i2c_master_write_byte(cmd, OLED_CMD_DISPLAY_RAM, true);				// A4
-	i2c_master_write_byte(cmd, OLED_CMD_SET_VCOMH_DESELCT, true);		// DB
-	i2c_master_write_byte(cmd, 0x40, true);
-	i2c_master_write_byte(cmd, OLED_CMD_SET_MEMORY_ADDR_MODE, true);	// 20
-	//i2c_master_write_byte(cmd, OLED_CMD_SET_HORI_ADDR_MODE, true);	// 00
-	i2c_master_write_byte(cmd, OLED_CMD_SET_PAGE_ADDR_MODE, true);		// 02
+	cmd[n++] = OLED_CMD_SET_COM_SCAN_MODE;		// C8
+	cmd[n++] = OLED_CMD_SET_DISPLAY_CLK_DIV;		// D5
+	cmd[n++] = 0x80;
+	cmd[n++] = OLED_CMD_SET_COM_PIN_MAP;			// DA
+	if (dev->_height == 64) cmd[n++] = 0x12;
+	if (dev->_height == 32) cmd[n++] = 0x02;
+	cmd[n++] = OLED_CMD_SET_CONTRAST;			// 81
+	cmd[n++] = 0xFF;
+	cmd[n++] = OLED_CMD_DISPLAY_RAM;				// A4
+	cmd[n++] = OLED_CMD_SET_VCOMH_DESELCT;		// DB
+	cmd[n++] = 0x40;
+	cmd[n++] = OLED_CMD_SET_MEMORY_ADDR_MODE;	// 20
+	//cmd[n++] = OLED_CMD_SET_HORI_ADDR_MODE;	// 00
+	cmd[n++] = OLED_CMD_SET_PAGE_ADDR_MODE;		// 02
 	// Set Lower Column Start Address for Page Addressing Mode
-	i2c_master_write_byte(cmd, 0x00, true);
+	cmd[n++] = 0x00;
 	// Set Higher Column Start Address for Page Addressing Mode
-	i2c_master_write_byte(cmd, 0x10, true);
-	i2c_master_write_byte(cmd, OLED_CMD_SET_CHARGE_PUMP, true);			// 8D
-	i2c_master_write_byte(cmd, 0x14, true);
-	i2c_master_write_byte(cmd, OLED_CMD_DEACTIVE_SCROLL, true);			// 2E
-	i2c_master_write_byte(cmd, OLED_CMD_DISPLAY_NORMAL, true);			// A6
-	i2c_master_write_byte(cmd, OLED_CMD_DISPLAY_ON, true);				// AF
-
-	i2c_master_stop(cmd);
-
-	esp_err_t espRc = i2c_master_cmd_begin(I2C_NUM, cmd, 10/portTICK_PERIOD_MS);
+	cmd[n++] = 0x10;
+	cmd[n++] = OLED_CMD_SET_CHARGE_PUMP;			// 8D
+	cmd[n++] = 0x14;
+	cmd[n++] = OLED_CMD_DEACTIVE_SCROLL;			// 2E
+	cmd[n++] = OLED_CMD_DISPLAY_NORMAL;			// A6
+	cmd[n++] = OLED_CMD_DISPLAY_ON;				// AF
+
+	esp_err_t espRc = i2cbus_write(i2c_client, dev->_address, cmd, n, 0);
 	if (espRc == ESP_OK) {
 		ESP_LOGI(tag, "OLED configured successfully");
 	} else {
 		ESP_LOGE(tag, "OLED configuration failed. code: 0x%.2X", espRc);
 	}
-	i2c_cmd_link_delete(cmd);
 }
 
 
 void i2c_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int width) {
-	i2c_cmd_handle_t cmd;
+	uint8_t cmd[32];
+	uint8_t data[1 + 128];
+	int n = 0;
 
 	if (page >= dev->_pages) return;
 	if (seg >= dev->_width) return;
+	if (width > 128) width = 128;
 
 	int _seg = seg + CONFIG_OFFSETX;
 	uint8_t columLow = _seg & 0x0F;
@@ -116,133 +125,125 @@ void i2c_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int
 		_page = (dev->_pages - page) - 1;
 	}
 
-	cmd = i2c_cmd_link_create();
-	i2c_master_start(cmd);
-	i2c_master_write_byte(cmd, (dev->_address << 1) | I2C_MASTER_WRITE, true);
-
-	i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_CMD_STREAM, true);
+	cmd[n++] = OLED_CONTROL_BYTE_CMD_STREAM;
 	// Set Lower Column Start Address for Page Addressing Mode
-	i2c_master_write_byte(cmd, (0x00 + columLow), true);
+	cmd[n++] = (0x00 + columLow);
 	// Set Higher Column Start Address for Page Addressing Mode
-	i2c_master_write_byte(cmd, (0x10 + columHigh), true);
+	cmd[n++] = (0x10 + columHigh);
 	// Set Page Start Address for Page Addressing Mode
-	i2c_master_write_byte(cmd, 0xB0 | _page, true);
+	cmd[n++] = 0xB0 | _page;
 
-	i2c_master_stop(cmd);
-	i2c_master_cmd_begin(I2C_NUM, cmd, 10/portTICK_PERIOD_MS);
-	i2c_cmd_link_delete(cmd);
-
-	cmd = i2c_cmd_link_create();
-	i2c_master_start(cmd);
-	i2c_master_write_byte(cmd, (dev->_address << 1) | I2C_MASTER_WRITE, true);
+	esp_err_t espRc = i2cbus_write(i2c_client, dev->_address, cmd, n, 0);
+	if (espRc != ESP_OK) {
+		ESP_LOGE(tag, "Page address command failed. code: 0x%.2X", espRc);
+		return;
+	}
 
-	i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_DATA_STREAM, true);
-	i2c_master_write(cmd, images, width, true);
+	data[0] = OLED_CONTROL_BYTE_DATA_STREAM;
+	memcpy(&data[1], images, width);
 
-	i2c_master_stop(cmd);
-	i2c_master_cmd_begin(I2C_NUM, cmd, 10/portTICK_PERIOD_MS);
-	i2c_cmd_link_delete(cmd);
+	espRc = i2cbus_write(i2c_client, dev->_address, data, 1 + width, 0);
+	if (espRc != ESP_OK) {
+		ESP_LOGE(tag, "Page data write failed. code: 0x%.2X", espRc);
+	}
 }
 
 void i2c_contrast(SSD1306_t * dev, int contrast) {
-	i2c_cmd_handle_t cmd;
+	uint8_t cmd[32];
+	int n = 0;
 	int _contrast = contrast;
 	if (contrast < 0x0) _contrast = 0;
 	if (contrast > 0xFF) _contrast = 0xFF;
 
-	cmd = i2c_cmd_link_create();
-	i2c_master_start(cmd);
-	i2c_master_write_byte(cmd, (dev->_address << 1) | I2C_MASTER_WRITE, true);
-	i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_CMD_STREAM, true);
-	i2c_master_write_byte(cmd, OLED_CMD_SET_CONTRAST, true);			// 81
-	i2c_master_write_byte(cmd, _contrast, true);
-	i2c_master_stop(cmd);
-	i2c_master_cmd_begin(I2C_NUM, cmd, 10/portTICK_PERIOD_MS);
-	i2c_cmd_link_delete(cmd);
+	cmd[n++] = OLED_CONTROL_BYTE_CMD_STREAM;
+	cmd[n++] = OLED_CMD_SET_CONTRAST;			// 81
+	cmd[n++] = _contrast;
+
+	esp_err_t espRc = i2cbus_write(i2c_client, dev->_address, cmd, n, 0);
+	if (espRc != ESP_OK) {
+		ESP_LOGE(tag, "Contrast command failed. code: 0x%.2X", espRc);
+	}
 }
 
 
 void i2c_hardware_scroll(SSD1306_t * dev, ssd1306_scroll_type_t scroll) {
 	esp_err_t espRc;
 
-	i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-	i2c_master_start(cmd);
+	uint8_t cmd[32];
+	int n = 0;
 
-	i2c_master_write_byte(cmd, (dev->_address << 1) | I2C_MASTER_WRITE, true);
-	i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_CMD_STREAM, true);
+	cmd[n++] = OLED_CONTROL_BYTE_CMD_STREAM;
 
 	if (scroll == SCROLL_RIGHT) {
-		i2c_master_write_byte(cmd, OLED_CMD_HORIZONTAL_RIGHT, true);	// 26
-		i2c_master_write_byte(cmd, 0x00, true); // Dummy byte
-		i2c_master_write_byte(cmd, 0x00, true); // Define start page address
-		i2c_master_write_byte(cmd, 0x07, true); // Frame frequency
-		i2c_master_write_byte(cmd, 0x07, true); // Define end page address
-		i2c_master_write_byte(cmd, 0x00, true); //
-		i2c_master_write_byte(cmd, 0xFF, true); //
-		i2c_master_write_byte(cmd, OLED_CMD_ACTIVE_SCROLL, true);		// 2F
+		cmd[n++] = OLED_CMD_HORIZONTAL_RIGHT;	// 26
+		cmd[n++] = 0x00; // Dummy byte
+		cmd[n++] = 0x00; // Define start page address
+		cmd[n++] = 0x07; // Frame frequency
+		cmd[n++] = 0x07; // Define end page address
+		cmd[n++] = 0x00; //
+		cmd[n++] = 0xFF; //
+		cmd[n++] = OLED_CMD_ACTIVE_SCROLL;		// 2F
 	} 
 
 	if (scroll == SCROLL_LEFT) {
-		i2c_master_write_byte(cmd, OLED_CMD_HORIZONTAL_LEFT, true);		// 27
-		i2c_master_write_byte(cmd, 0x00, true); // Dummy byte
-		i2c_master_write_byte(cmd, 0x00, true); // Define start page address
-		i2c_master_write_byte(cmd, 0x07, true); // Frame frequency
-		i2c_master_write_byte(cmd, 0x07, true); // Define end page address
-		i2c_master_write_byte(cmd, 0x00, true); //
-		i2c_master_write_byte(cmd, 0xFF, true); //
-		i2c_master_write_byte(cmd, OLED_CMD_ACTIVE_SCROLL, true);		// 2F
+		cmd[n++] = OLED_CMD_HORIZONTAL_LEFT;		// 27
+		cmd[n++] = 0x00; // Dummy byte
+		cmd[n++] = 0x00; // Define start page address
+		cmd[n++] = 0x07; // Frame frequency
+		cmd[n++] = 0x07; // Define end page address
+		cmd[n++] = 0x00; //
+		cmd[n++] = 0xFF; //
+		cmd[n++] = OLED_CMD_ACTIVE_SCROLL;		// 2F
 	} 
 
 	if (scroll == SCROLL_DOWN) {
-		i2c_master_write_byte(cmd, OLED_CMD_CONTINUOUS_SCROLL, true);	// 29
-		i2c_master_write_byte(cmd, 0x00, true); // Dummy byte
-		i2c_master_write_byte(cmd, 0x00, true); // Define start page address
-		i2c_master_write_byte(cmd, 0x07, true); // Frame frequency
-		//i2c_master_write_byte(cmd, 0x01, true); // Define end page address
-		i2c_master_write_byte(cmd, 0x00, true); // Define end page address
-		i2c_master_write_byte(cmd, 0x3F, true); // Vertical scrolling offset
-
-		i2c_master_write_byte(cmd, OLED_CMD_VERTICAL, true);			// A3
-		i2c_master_write_byte(cmd, 0x00, true);
+		cmd[n++] = OLED_CMD_CONTINUOUS_SCROLL;	// 29
+		cmd[n++] = 0x00; // Dummy byte
+		cmd[n++] = 0x00; // Define start page address
+		cmd[n++] = 0x07; // Frame frequency
+		//cmd[n++] = 0x01; // Define end page address
+		cmd[n++] = 0x00; // Define end page address
+		cmd[n++] = 0x3F; // Vertical scrolling offset
+
+		cmd[n++] = OLED_CMD_VERTICAL;			// A3
+		cmd[n++] = 0x00;
 		if (dev->_height == 64)
-		//i2c_master_write_byte(cmd, 0x7F, true);
-		i2c_master_write_byte(cmd, 0x40, true);
+		//cmd[n++] = 0x7F;
+		cmd[n++] = 0x40;
 		if (dev->_height == 32)
-		i2c_master_write_byte(cmd, 0x20, true);
-		i2c_master_write_byte(cmd, OLED_CMD_ACTIVE_SCROLL, true);		// 2F
+		cmd[n++] = 0x20;
+		cmd[n++] = OLED_CMD_ACTIVE_SCROLL;		// 2F
 	}
 
 	if (scroll == SCROLL_UP) {
-		i2c_master_write_byte(cmd, OLED_CMD_CONTINUOUS_SCROLL, true);	// 29
-		i2c_master_write_byte(cmd, 0x00, true); // Dummy byte
-		i2c_master_write_byte(cmd, 0x00, true); // Define start page address
-		i2c_master_write_byte(cmd, 0x07, true); // Frame frequency
-		//i2c_master_write_byte(cmd, 0x01, true); // Define end page address
-		i2c_master_write_byte(cmd, 0x00, true); // Define end page address
-		i2c_master_write_byte(cmd, 0x01, true); // Vertical scrolling offset
-
-		i2c_master_write_byte(cmd, OLED_CMD_VERTICAL, true);			// A3
-		i2c_master_write_byte(cmd, 0x00, true);
+		cmd[n++] = OLED_CMD_CONTINUOUS_SCROLL;	// 29
+		cmd[n++] = 0x00; // Dummy byte
+		cmd[n++] = 0x00; // Define start page address
+		cmd[n++] = 0x07; // Frame frequency
+		//cmd[n++] = 0x01; // Define end page address
+		cmd[n++] = 0x00; // Define end page address
+		cmd[n++] = 0x01; // Vertical scrolling offset
+
+		cmd[n++] = OLED_CMD_VERTICAL;			// A3
+		cmd[n++] = 0x00;
 		if (dev->_height == 64)
-		//i2c_master_write_byte(cmd, 0x7F, true);
-		i2c_master_write_byte(cmd, 0x40, true);
+		//cmd[n++] = 0x7F;
+		cmd[n++] = 0x40;
 		if (dev->_height == 32)
-		i2c_master_write_byte(cmd, 0x20, true);
-		i2c_master_write_byte(cmd, OLED_CMD_ACTIVE_SCROLL, true);		// 2F
+		cmd[n++] = 0x20;
+		cmd[n++] = OLED_CMD_ACTIVE_SCROLL;		// 2F
 	}
 
 	if (scroll == SCROLL_STOP) {
-		i2c_master_write_byte(cmd, OLED_CMD_DEACTIVE_SCROLL, true);		// 2E
+		cmd[n++] = OLED_CMD_DEACTIVE_SCROLL;		// 2E
 	}
 
-	i2c_master_stop(cmd);
-	espRc = i2c_master_cmd_begin(I2C_NUM, cmd, 10/portTICK_PERIOD_MS);
+	espRc = i2cbus_write(i2c_client, dev->_address, cmd, n, 0);
 	if (espRc == ESP_OK) {
 		ESP_LOGD(tag, "Scroll command succeeded");
 	} else {
 		ESP_LOGE(tag, "Scroll command failed. code: 0x%.2X", espRc);
 	}
 
-	i2c_cmd_link_delete(cmd);
 }
 
@@ -1,18 +1,18 @@
 #include <freertos/Freertos.h>
 #include <freertos/task.h>
 #include <freertos/semphr.h>
-#include <freertos/queue.h>
 #include <driver/ledc.h>
 #include <driver/pcnt.h>
 #include <driver/adc.h>
 #include <driver/periph_ctrl.h>
-#include <soc/pcnt_struct.h>
-#include <soc/pcnt_reg.h>
 #include <esp_err.h>
+#include <esp_timer.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "../components/ssd1306/ssd1306.h"
+#include "../components/freqmeter/freqmeter.h"
+#include "../components/freqgen/freqgen.h"
 
 #define GPIO_PULSEIN    25
 #define GPIO_FREQGEN    26
@@ -23,25 +23,47 @@
 #define PWM_FREQ        2000
 #define PWM_RES         LEDC_TIMER_2_BIT
 
+// 1: il generatore segue una sequenza fissa invece del potenziometro e ogni
+// misura e' confrontata con la frequenza generata (GPIO_FREQGEN -> GPIO_PULSEIN)
+#define SIM_SWEEP       0
+#define SIM_STEP_MS     2000
+
+#define GATE_MS         20          // Intervallo desiderato fra due campioni
+#define AVG_N           8           // Intervalli nella media mobile
+#define OLED_MS         250
+
+// Canale i = unita' PCNT i; il canale 0 e' quello mostrato sull'OLED
+#define N_CHANNELS      1
+
+// GPIO33 (ADC1_CH5) e' escluso: e' l'ingresso del potenziometro letto da task_loop
+static const int g_pulse_gpio[PCNT_UNIT_MAX] = {GPIO_PULSEIN, 27, 32, 18, 34, 35, 36, 39};
+
 static int32_t g_app_cpu = 0;
-static pcnt_isr_handle_t gh_isr_handle = NULL;
 static SemaphoreHandle_t gh_sem = NULL;
-static QueueHandle_t gh_evtq = NULL;
+static freqgen_t g_gen = {0};
 
 static void counter_init(void);
 static void display_init(SSD1306_t * dev);
 static void pwm_init(uint32_t frequency);
-static void IRAM_ATTR isr_pulse(void * p_arg);
 static void task_loop(void * p_arg);
 static void task_monitor(void * p_arg);
 static void display_clear(SSD1306_t * dev);
 static void oled_lock(void);
 static void oled_unlock(void);
 static void analog_init(void);
-static uint32_t retarget(uint32_t freq, uint32_t usec);
 static void oled_freq(SSD1306_t * dev, uint32_t frequency);
 static void oled_gen(SSD1306_t * dev, uint32_t frequency);
 
+#if SIM_SWEEP
+// 0 = generatore fermo: verifica il percorso di timeout (impulsi mancanti)
+static const uint32_t g_sweep[] = {500, 1000, 5000, 20000, 0, 100000, 300000, 2000};
+
+#define SWEEP_STEPS (sizeof(g_sweep) / sizeof(g_sweep[0]))
+
+static volatile uint32_t g_gen_freq = 0;
+static volatile int64_t g_gen_us = 0;       // Istante dell'ultimo cambio
+#endif /* SIM_SWEEP */
+
 void
 app_main (void)
 {
@@ -51,8 +73,6 @@ app_main (void)
     g_app_cpu = xPortGetCoreID();
     gh_sem = xSemaphoreCreateMutex();
     assert(gh_sem != NULL);
-    gh_evtq = xQueueCreate(20, sizeof(uint32_t));
-    assert(gh_evtq != NULL);
 
     pwm_init(PWM_FREQ);
     counter_init();
@@ -73,203 +93,160 @@ task_loop (void * p_arg)
     uint32_t freq = 0;
     SSD1306_t * dev = (SSD1306_t *) p_arg;
 
-    for (;;)
+#if SIM_SWEEP
+    for (uint32_t step = 0; ; ++step)
     {
-        freq = adc1_get_raw(ADC1_CHANNEL_5) * 80 + 500;
+        freq = g_sweep[step % SWEEP_STEPS];
         oled_gen(dev, freq);
 
-        pwm_init(freq);
-        vTaskDelay(pdMS_TO_TICKS(1000));
-    }
-}
-
-static void
-task_monitor (void * p_arg)
-{
-    uint32_t usecs = 0;
-    int16_t thres = 0;
-    BaseType_t ret = 0;
-    SSD1306_t * dev = (SSD1306_t *) p_arg;
-    
-    for (;;)
-    {
-        ESP_ERROR_CHECK(pcnt_counter_clear(PCNT_UNIT_0));
-        xQueueReset(gh_evtq);
-        ESP_ERROR_CHECK(pcnt_counter_resume(PCNT_UNIT_0));
-
-        ESP_ERROR_CHECK(pcnt_get_event_value(PCNT_UNIT_0, PCNT_EVT_THRES_1, &thres));
-        ret = xQueueReceive(gh_evtq, &usecs, 500);
-
-        if (pdPASS == ret)
+        if (0 == freq)
         {
-            uint32_t frequency = (((uint64_t) thres) - 10) * (uint64_t) 1000000 / usecs;
-            oled_freq(dev, frequency);
-            thres = retarget(frequency, usecs);
-            ESP_ERROR_CHECK(pcnt_set_event_value(PCNT_UNIT_0, PCNT_EVT_THRES_1, thres));
+            ESP_ERROR_CHECK(freqgen_stop(&g_gen));
         }
         else
         {
-            ESP_ERROR_CHECK(pcnt_counter_pause(PCNT_UNIT_0));
-            ESP_ERROR_CHECK(pcnt_set_event_value(PCNT_UNIT_0, PCNT_EVT_THRES_1, 25));
+            ESP_ERROR_CHECK(freqgen_set(&g_gen, freq));
+            printf("gen %u Hz: retune %u us (%u fast, %u full)\n", freq, g_gen.last_us, g_gen.n_fast, g_gen.n_full);
         }
+
+        g_gen_us = esp_timer_get_time();
+        g_gen_freq = freq;
+        vTaskDelay(pdMS_TO_TICKS(SIM_STEP_MS));
+    }
+#else
+    for (;;)
+    {
+        freq = adc1_get_raw(ADC1_CHANNEL_5) * 80 + 500;
+        oled_gen(dev, freq);
+
+        // Stessa frequenza: nessun accesso al LEDC; piccole variazioni: solo
+        // il divisore, senza riconfigurare timer e canale
+        //
+        ESP_ERROR_CHECK(freqgen_set(&g_gen, freq));
+        vTaskDelay(pdMS_TO_TICKS(1000));
     }
+#endif /* SIM_SWEEP */
 }
 
+#if SIM_SWEEP
+// Errore relativo rispetto alla frequenza generata, tempo di assestamento
+// dopo il cambio (prima misura entro l'1%) e costo in interrupt al secondo
+//
 static void
-IRAM_ATTR isr_pulse (void * p_arg)
+sweep_check (bool b_valid, uint32_t frequency)
 {
-    static uint32_t usecs0 = 0;
-    uint32_t intr_status = PCNT.int_st.val;
-    uint32_t evt_status;
-    uint32_t usecs;
-    BaseType_t woken = pdFALSE;
-
-    if (1 == (intr_status & BIT(0)))
+    static uint32_t last_freq = UINT32_MAX;
+    static bool b_settled = false;
+    static uint32_t err_max_ppm = 0;
+    static uint32_t n_wrong = 0;
+    static uint32_t isr0 = 0;
+    uint32_t gen = g_gen_freq;
+    int64_t elapsed = esp_timer_get_time() - g_gen_us;
+    uint32_t err_ppm = 0;
+
+    if (gen != last_freq)
     {
-        evt_status = PCNT.status_unit[0].val;
-
-        if ((evt_status & PCNT_STATUS_THRES0_M) != 0)
+        if (last_freq != UINT32_MAX)
         {
-            usecs0 = esp_timer_get_time();
-        }
-        else if ((evt_status & PCNT_STATUS_THRES1_M) != 0)
-        {
-            usecs = esp_timer_get_time() - usecs0;
-            xQueueSendFromISR(gh_evtq, &usecs, &woken);
-            pcnt_counter_pause(PCNT_UNIT_0);
+            printf("sweep %u Hz: max error %u ppm, %u wrong, %u isr/s\n", last_freq, err_max_ppm, n_wrong,
+                   (uint32_t) ((uint64_t) (freqmeter_isr_count() - isr0) * 1000 / SIM_STEP_MS));
         }
 
-        PCNT.int_clr.val = BIT(0);
+        last_freq = gen;
+        b_settled = false;
+        err_max_ppm = 0;
+        n_wrong = 0;
+        isr0 = freqmeter_isr_count();
     }
 
-    if (woken != 0)
+    if (0 == gen)
     {
-        portYIELD_FROM_ISR();
+        n_wrong += b_valid ? 1 : 0;
+        return;
     }
-}
 
-static uint64_t
-target (uint32_t usec, uint32_t freq)
-{
-    if (freq > 100000)
+    if (!b_valid)
     {
-        return ((uint64_t) freq / 1000 * usec / 1000 + 10);
+        n_wrong += b_settled ? 1 : 0;
+        return;
     }
-    else
+
+    err_ppm = (uint32_t) ((uint64_t) ((frequency > gen) ? frequency - gen : gen - frequency) * 1000000 / gen);
+
+    if (!b_settled && (err_ppm < 10000))
     {
-        return ((uint64_t) freq * usec / 1000000 + 10);
+        b_settled = true;
+        printf("sweep %u Hz: settled after %lld ms\n", gen, elapsed / 1000);
     }
-}
 
-static uint64_t
-useconds (uint64_t thres, uint32_t freq)
-{
-    return ((thres - 10) * 1000000 / freq);
+    if (b_settled && (err_ppm > err_max_ppm))
+    {
+        err_max_ppm = err_ppm;
+    }
 }
+#endif /* SIM_SWEEP */
 
-static uint32_t
-retarget (uint32_t freq, uint32_t usec)
+static void
+task_monitor (void * p_arg)
 {
-    static const uint32_t target_usecs = 100000;
-    uint64_t thres = 0;
-    uint64_t usecs = 0;
-
-    thres = target(usec, freq);
+    freqmeter_result_t result = {0};
+    bool b_valid = false;
+    TickType_t ticktime = xTaskGetTickCount();
+    SSD1306_t * dev = (SSD1306_t *) p_arg;
 
-    if (thres > 32000)
+    // Le misure arrivano dall'ISR senza tempi morti: il task legge solo
+    // l'ultimo valore pubblicato di ogni canale
+    //
+    for (;;)
     {
-        thres = target(target_usecs, freq);
+        vTaskDelayUntil(&ticktime, pdMS_TO_TICKS(OLED_MS));
 
-        if (thres > 32500)
-        {
-            thres = 32500;
-        }
+        b_valid = freqmeter_get(PCNT_UNIT_0, &result);
+        oled_freq(dev, result.hz);
 
-        usecs = useconds(thres, freq);
-        thres = target(usecs, freq);
-    }
-    else
-    {
-        thres = target(target_usecs, freq);
+#if SIM_SWEEP
+        sweep_check(b_valid, result.hz);
+#endif /* SIM_SWEEP */
 
-        if (thres < 25)
+        for (uint32_t unit = 1; unit < N_CHANNELS; ++unit)
         {
-            thres = 25;
+            b_valid = freqmeter_get(unit, &result);
+            printf("ch%u: %u Hz%s\n", unit, result.hz, b_valid ? "" : " (no signal)");
         }
-
-        usecs = useconds(thres, freq);
-        thres = target(usecs, freq);
-    }
-
-    if (thres > 32500)
-    {
-        thres = 32500;
-    }
-    else if (thres < 25)
-    {
-        thres = 25;
     }
-
-    return thres;
 }
 
 static void
 counter_init (void)
 {
-    pcnt_config_t cfg = {0};
-    static int32_t pcnt_unit = 0;
-
-    cfg.pulse_gpio_num = GPIO_PULSEIN;
-    cfg.ctrl_gpio_num = PCNT_PIN_NOT_USED;
-    cfg.channel = PCNT_CHANNEL_0;
-    cfg.unit = PCNT_UNIT_0;
-    cfg.pos_mode = PCNT_COUNT_INC;
-    cfg.neg_mode = PCNT_COUNT_DIS;
-    cfg.lctrl_mode = PCNT_MODE_KEEP;
-    cfg.hctrl_mode = PCNT_MODE_KEEP;
-    cfg.counter_h_lim = 32767;
-    cfg.counter_l_lim = 0;
-
-    pcnt_unit = PCNT_UNIT_0;
-    
-    ESP_ERROR_CHECK(pcnt_unit_config(&cfg));
-    
-    ESP_ERROR_CHECK(pcnt_set_event_value(PCNT_UNIT_0, PCNT_EVT_THRES_0, 10));
-    ESP_ERROR_CHECK(pcnt_set_event_value(PCNT_UNIT_0, PCNT_EVT_THRES_1, 10000));
+    freqmeter_config_t cfg = {0};
 
-    ESP_ERROR_CHECK(pcnt_event_enable(PCNT_UNIT_0, PCNT_EVT_THRES_0));
-    ESP_ERROR_CHECK(pcnt_event_enable(PCNT_UNIT_0, PCNT_EVT_THRES_1));
+    cfg.gate_ms = GATE_MS;
+    cfg.avg_n = AVG_N;
 
-    ESP_ERROR_CHECK(pcnt_counter_pause(PCNT_UNIT_0));
-    
-    ESP_ERROR_CHECK(pcnt_isr_register(isr_pulse, &pcnt_unit, 0, &gh_isr_handle));
-    ESP_ERROR_CHECK(pcnt_intr_enable(PCNT_UNIT_0));
+    ESP_ERROR_CHECK(freqmeter_init());
+
+    for (uint32_t unit = 0; unit < N_CHANNELS; ++unit)
+    {
+        cfg.gpio = g_pulse_gpio[unit];
+        ESP_ERROR_CHECK(freqmeter_add(unit, &cfg));
+    }
 }
 
 static void
 pwm_init (uint32_t frequency)
 {
-    // Prepare and then apply the LEDC PWM timer configuration
-    ledc_timer_config_t ledc_timer = {
-        .speed_mode       = LEDC_LOW_SPEED_MODE,
-        .timer_num        = LEDC_TIMER_0,
-        .duty_resolution  = PWM_RES,
-        .freq_hz          = frequency,
-        .clk_cfg          = LEDC_AUTO_CLK
-    };
-    // Prepare and then apply the LEDC PWM channel configuration
-    ledc_channel_config_t ledc_channel = {
+    freqgen_config_t cfg = {
         .speed_mode     = LEDC_LOW_SPEED_MODE,
+        .timer          = LEDC_TIMER_0,
         .channel        = PWM_CH,
-        .timer_sel      = LEDC_TIMER_0,
-        .intr_type      = LEDC_INTR_DISABLE,
-        .gpio_num       = PWM_GPIO,
-        .hpoint         = 0,
+        .gpio           = PWM_GPIO,
+        .resolution     = PWM_RES,
         .duty           = 2
     };
 
-    ESP_ERROR_CHECK(ledc_timer_config(&ledc_timer));
-    ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel));
+    ESP_ERROR_CHECK(freqgen_init(&g_gen, &cfg));
+    ESP_ERROR_CHECK(freqgen_set(&g_gen, frequency));
 }
 
 static void